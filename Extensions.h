@@ -0,0 +1,174 @@
+#ifndef EXTENSIONS_H
+#define EXTENSIONS_H
+
+#include <bitset>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+/*
+	The extensions the library looks for have an enum value each, checking
+	one of those is a single bit test:
+
+		if (shared->glxExtensions.has(GlxExt::EXT_swap_control)) ...
+
+	Any other name is looked up with a binary search in the sorted list of
+	all the names, built the first time it is needed.
+*/
+enum class GlxExt {
+	ARB_create_context,
+	ARB_context_flush_control,
+	ARB_framebuffer_sRGB,
+	EXT_framebuffer_sRGB,
+	EXT_swap_control,
+	EXT_swap_control_tear,
+	MESA_swap_control,
+	SGI_swap_control,
+	EXT_buffer_age,
+	NV_swap_group,
+	SGIX_swap_group,
+	MESA_query_renderer,
+	COUNT
+};
+
+enum class GlExt {
+	ARB_sync,
+	ARB_debug_output,
+	KHR_debug,
+	ARB_buffer_storage,
+	ARB_timer_query,
+	COUNT
+};
+
+struct GlxExtNames {
+	static const char *get (int index) {
+		static const char *const names[] = {
+			"GLX_ARB_create_context",
+			"GLX_ARB_context_flush_control",
+			"GLX_ARB_framebuffer_sRGB",
+			"GLX_EXT_framebuffer_sRGB",
+			"GLX_EXT_swap_control",
+			"GLX_EXT_swap_control_tear",
+			"GLX_MESA_swap_control",
+			"GLX_SGI_swap_control",
+			"GLX_EXT_buffer_age",
+			"GLX_NV_swap_group",
+			"GLX_SGIX_swap_group",
+			"GLX_MESA_query_renderer"
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == (int)GlxExt::COUNT,
+				"a name for every GlxExt");
+		return names[index];
+	}
+};
+
+struct GlExtNames {
+	static const char *get (int index) {
+		static const char *const names[] = {
+			"GL_ARB_sync",
+			"GL_ARB_debug_output",
+			"GL_KHR_debug",
+			"GL_ARB_buffer_storage",
+			"GL_ARB_timer_query"
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == (int)GlExt::COUNT,
+				"a name for every GlExt");
+		return names[index];
+	}
+};
+
+template <typename Ext, typename Names>
+class ExtensionSet {
+public:
+	static const int COUNT = (int)Ext::COUNT;
+
+	// from a space separated list, like the GLX or the legacy GL string
+	void setString (const char *extensions) {
+		clear();
+		source = extensions ? extensions : "";
+		for (int i = 0; i < COUNT; i++)
+			known[i] = contains(source, Names::get(i));
+	}
+
+	// from the names one by one, like glGetStringi returns them
+	void add (const char *name) {
+		if (!name)
+			return;
+		for (int i = 0; i < COUNT; i++)
+			if (!strcmp(name, Names::get(i)))
+				known[i] = true;
+		names.push_back(name);
+		sorted = false;
+	}
+
+	bool has (Ext ext) const {
+		return known[(int)ext];
+	}
+
+	bool has (const char *name) {
+		if (!name)
+			return false;
+		for (int i = 0; i < COUNT; i++)
+			if (!strcmp(name, Names::get(i)))
+				return known[i];
+
+		intern();
+		return std::binary_search(names.begin(), names.end(), name);
+	}
+
+	void clear() {
+		known.reset();
+		names.clear();
+		source.clear();
+		sorted = true;
+	}
+
+private:
+	std::bitset<COUNT> known;
+	std::vector<std::string> names;
+	std::string source;
+	bool sorted = true;
+
+	void intern() {
+		if (!source.empty()) {
+			size_t start = 0;
+			while (start < source.size()) {
+				size_t end = source.find(' ', start);
+				if (end == std::string::npos)
+					end = source.size();
+				if (end > start)
+					names.push_back(source.substr(start, end - start));
+				start = end + 1;
+			}
+			source.clear();
+			sorted = false;
+		}
+		if (!sorted) {
+			std::sort(names.begin(), names.end());
+			names.erase(std::unique(names.begin(), names.end()), names.end());
+			sorted = true;
+		}
+	}
+
+	// whole word match, used only for the known names
+	static bool contains (const std::string& list, const char *extension) {
+		size_t len = strlen(extension);
+		size_t pos = 0;
+
+		while ((pos = list.find(extension, pos)) != std::string::npos) {
+			bool start = pos == 0 || list[pos - 1] == ' ';
+			bool end = pos + len == list.size() || list[pos + len] == ' ';
+			if (start && end)
+				return true;
+			pos += len;
+		}
+		return false;
+	}
+};
+
+using GlxExtensionSet = ExtensionSet<GlxExt, GlxExtNames>;
+using GlExtensionSet = ExtensionSet<GlExt, GlExtNames>;
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef FB_CONFIG_H
+#define FB_CONFIG_H
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <X11/Xlib.h>
+#include "XStats.h"
+#include "GlxStartupCache.h"
+
+// what a window asks for, the chosen config is the closest one available
+struct FBConfigRequest {
+	int samples = 0;
+	int depth = 24;
+	int stencil = 8;
+	bool srgb = false;
+	bool doubleBuffer = true;
+
+	bool operator < (const FBConfigRequest& other) const {
+		return std::tie(samples, depth, stencil, srgb, doubleBuffer) <
+				std::tie(other.samples, other.depth, other.stencil, other.srgb,
+				other.doubleBuffer);
+	}
+};
+
+struct FBConfigChoice {
+	GLXFBConfig config = 0;
+	XVisualInfo *visualInfo = NULL;
+	Colormap colormap = None;
+	int id = 0;			// GLX_FBCONFIG_ID
+	int samples = 0;
+	int depth = 0;
+	int stencil = 0;
+	bool srgb = false;
+	bool doubleBuffer = false;
+	int caveat = GLX_NONE;	// GLX_SLOW_CONFIG or GLX_NON_CONFORMANT_CONFIG
+	int visualDepth = 0;	// 32 for the ARGB visuals a compositor blends
+	bool fromCache = false;	// taken from the startup cache, not scored
+};
+
+// Enumerates the configs of a screen once and keeps, for every request, the
+// chosen config together with its visual and colormap, so later windows
+// don't ask the server again. Owned by LinuxDisplay, everything it hands out
+// lives as long as the display.
+class FBConfigCache {
+public:
+	void setDisplay (Display *display, int screen, Window root,
+			GlxStartupCache *startupCache = NULL)
+	{
+		this->display = display;
+		this->screen = screen;
+		this->root = root;
+		this->startupCache = startupCache;
+		defaultDepth = DefaultDepth(display, screen);
+	}
+
+	// throws if there is no usable config at all
+	const FBConfigChoice& choose (const FBConfigRequest& request) {
+		auto it = chosen.find(request);
+		if (it != chosen.end())
+			return it->second;
+
+		// The config that won on the last run, if the driver still has it
+		// and it is still what it was then. Anything else and the configs
+		// are enumerated and scored again.
+		GlxStartupCacheData::Config record;
+		FBConfigChoice cached;
+		const FBConfigChoice *best = NULL;
+		if (startupCache && startupCache->fbConfig(attribsOf(request),
+				record))
+		{
+			cached.id = record.id;
+			cached.fromCache = true;
+			if (findById(cached) && attribsOf(cached) == record.chosen &&
+					cached.caveat == GLX_NONE &&
+					cached.visualDepth == defaultDepth)
+				best = &cached;
+		}
+
+		if (!best) {
+			if (!enumerated)
+				enumerate();
+
+			int bestPenalty = 0;
+			for (auto&& candidate : candidates) {
+				int penalty = score(request, candidate);
+				if (!best || penalty < bestPenalty) {
+					best = &candidate;
+					bestPenalty = penalty;
+				}
+			}
+		}
+
+		if (!best)
+			throw std::runtime_error("Failed to get a GLXFBConfig");
+
+		if (best->samples != request.samples)
+			printf("MSAA x%d not available ... using x%d\n",
+					request.samples, best->samples);
+
+		FBConfigChoice choice = *best;
+		if ((choice.visualInfo = glXGetVisualFromFBConfig(display,
+				choice.config)) == NULL)
+			throw std::runtime_error("No visual chosen");
+		choice.colormap = XCreateColormap(display, root,
+				choice.visualInfo->visual, AllocNone);
+
+		return chosen[request] = choice;
+	}
+
+	// writes the choice to the startup cache for the next run
+	void record (const FBConfigRequest& request, const FBConfigChoice& choice) {
+		if (startupCache)
+			startupCache->setFBConfig({attribsOf(request), attribsOf(choice),
+					choice.id});
+	}
+
+	void clear() {
+		for (auto&& pair : chosen) {
+			XFreeColormap(display, pair.second.colormap);
+			XFree(pair.second.visualInfo);
+		}
+		chosen.clear();
+		candidates.clear();
+		enumerated = false;
+	}
+
+private:
+	Display *display = NULL;
+	int screen = 0;
+	Window root = None;
+	int defaultDepth = 24;
+	GlxStartupCache *startupCache = NULL;
+
+	bool enumerated = false;
+	std::vector<FBConfigChoice> candidates;
+	std::map<FBConfigRequest, FBConfigChoice> chosen;
+
+	static GlxStartupCacheData::Attribs attribsOf (
+			const FBConfigRequest& request)
+	{
+		return {request.samples, request.depth, request.stencil,
+				request.srgb, request.doubleBuffer};
+	}
+
+	static GlxStartupCacheData::Attribs attribsOf (
+			const FBConfigChoice& choice)
+	{
+		return {choice.samples, choice.depth, choice.stencil, choice.srgb,
+				choice.doubleBuffer};
+	}
+
+	// Keeps only the configs a window can use at all, the attributes are
+	// read once here and the scoring doesn't touch GLX again. The configs
+	// come in the order of glXChooseFBConfig, which breaks the ties.
+	void enumerate() {
+		const int attribs[] = {
+			GLX_X_RENDERABLE, True,
+			GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+			GLX_RENDER_TYPE, GLX_RGBA_BIT,
+			GLX_X_VISUAL_TYPE, GLX_TRUE_COLOR,
+			GLX_RED_SIZE, 8,
+			GLX_GREEN_SIZE, 8,
+			GLX_BLUE_SIZE, 8,
+			GLX_ALPHA_SIZE, 8,
+			None
+		};
+		int count = 0;
+		GLXFBConfig *configs;
+		{
+			XStatsRoundTrip roundTrip;
+			configs = glXChooseFBConfig(display, screen, attribs, &count);
+		}
+
+		for (int i = 0; configs && i < count; i++) {
+			FBConfigChoice candidate;
+			if (readConfig(configs[i], candidate))
+				candidates.push_back(candidate);
+		}
+
+		if (configs)
+			XFree(configs);
+		enumerated = true;
+	}
+
+	// asks GLX for the config with choice.id alone, skipping the enumeration
+	bool findById (FBConfigChoice& choice) {
+		const int attribs[] = {GLX_FBCONFIG_ID, choice.id, None};
+		int count = 0;
+		GLXFBConfig *configs;
+		{
+			XStatsRoundTrip roundTrip;
+			configs = glXChooseFBConfig(display, screen, attribs, &count);
+		}
+
+		bool found = configs && count >= 1 && readConfig(configs[0], choice);
+		if (configs)
+			XFree(configs);
+		return found;
+	}
+
+	// false if a window can't use the config at all
+	bool readConfig (GLXFBConfig config, FBConfigChoice& choice) {
+		auto attrib = [&](int name) {
+			int value = 0;
+			glXGetFBConfigAttrib(display, config, name, &value);
+			return value;
+		};
+
+		if (!attrib(GLX_X_RENDERABLE) || !attrib(GLX_VISUAL_ID) ||
+				!(attrib(GLX_DRAWABLE_TYPE) & GLX_WINDOW_BIT) ||
+				!(attrib(GLX_RENDER_TYPE) & GLX_RGBA_BIT) ||
+				attrib(GLX_X_VISUAL_TYPE) != GLX_TRUE_COLOR ||
+				attrib(GLX_RED_SIZE) < 8 || attrib(GLX_GREEN_SIZE) < 8 ||
+				attrib(GLX_BLUE_SIZE) < 8 || attrib(GLX_ALPHA_SIZE) < 8)
+			return false;
+
+		choice.config = config;
+		choice.id = attrib(GLX_FBCONFIG_ID);
+		choice.samples = attrib(GLX_SAMPLE_BUFFERS) ? attrib(GLX_SAMPLES) : 0;
+		choice.depth = attrib(GLX_DEPTH_SIZE);
+		choice.stencil = attrib(GLX_STENCIL_SIZE);
+		choice.srgb = attrib(GLX_FRAMEBUFFER_SRGB_CAPABLE_ARB);
+		choice.doubleBuffer = attrib(GLX_DOUBLEBUFFER);
+		choice.caveat = attrib(GLX_CONFIG_CAVEAT);
+
+		XVisualInfo *visual = glXGetVisualFromFBConfig(display, config);
+		if (!visual)
+			return false;
+		choice.visualDepth = visual->depth;
+		XFree(visual);
+		return true;
+	}
+
+	// Lower is better, missing features weigh more than extra ones. A slow or
+	// non-conformant config, or a visual deeper than the screen's (which
+	// makes the window translucent under a compositor), is only taken if
+	// there is nothing else.
+	int score (const FBConfigRequest& request,
+			const FBConfigChoice& candidate) const
+	{
+		int penalty = 0;
+
+		if (candidate.caveat != GLX_NONE)
+			penalty += 100000;
+		if (candidate.visualDepth != defaultDepth)
+			penalty += 50000;
+		if (candidate.doubleBuffer != request.doubleBuffer)
+			penalty += 10000;
+		if (candidate.depth < request.depth)
+			penalty += 1000 + request.depth - candidate.depth;
+		else
+			penalty += candidate.depth - request.depth;
+		if (candidate.stencil < request.stencil)
+			penalty += 1000 + request.stencil - candidate.stencil;
+		else
+			penalty += candidate.stencil - request.stencil;
+		if (request.srgb && !candidate.srgb)
+			penalty += 500;
+		if (candidate.samples < request.samples)
+			penalty += 10 * (request.samples - candidate.samples);
+		else
+			penalty += 2 * (candidate.samples - request.samples);
+
+		return penalty;
+	}
+};
+
+#endif
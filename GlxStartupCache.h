@@ -0,0 +1,298 @@
+#ifndef GLX_STARTUP_CACHE_H
+#define GLX_STARTUP_CACHE_H
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <X11/Xlib.h>
+#include "XStats.h"
+
+/*
+	Remembers what the GLX probing found on the last run, so a warm start
+	goes straight to the config and context version that worked.
+
+	The file is a single fixed size record, read with mmap and written whole
+	to a temporary file that is renamed over the old one. It is keyed by the
+	X server and GLX vendor/version strings, known before any context exists,
+	and with GLX_MESA_query_renderer by the renderer and its version too.
+	Without that extension nothing in the record is used until a context
+	was current and the GL renderer and version matched, so a driver change
+	throws the record away before any of it is trusted.
+
+	Location: $WINDOW_GLX_CACHE, else $XDG_CACHE_HOME/window-glx.cache, else
+	~/.cache/window-glx.cache. WINDOW_GLX_CACHE=off disables it.
+*/
+struct GlxStartupCacheData {
+	static const uint32_t MAGIC = 0x58474c57;	// "WLGX"
+	static const uint32_t VERSION = 4;
+	static const int MAX_CONFIGS = 16;
+	static const int MAX_STRING = 128;
+
+	struct Attribs {
+		int32_t samples;
+		int32_t depth;
+		int32_t stencil;
+		int32_t srgb;
+		int32_t doubleBuffer;
+
+		bool operator == (const Attribs& other) const {
+			return !memcmp(this, &other, sizeof(*this));
+		}
+	};
+
+	struct Config {
+		Attribs request;
+		Attribs chosen;		// what the chosen config had when it won
+		int32_t id;			// GLX_FBCONFIG_ID of the chosen config
+	};
+
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	char renderer[MAX_STRING];
+	char glVersion[MAX_STRING];
+
+	int32_t contextMajor;	// 0 means nothing was recorded yet
+	int32_t contextMinor;
+
+	uint32_t configCount;
+	Config configs[MAX_CONFIGS];
+};
+
+static_assert(std::is_trivially_copyable<GlxStartupCacheData>::value,
+		"the cache record is copied to and from the file as is");
+
+class GlxStartupCache {
+public:
+	// queryRenderer tells if the display has GLX_MESA_query_renderer
+	void load (Display *display, int screen, bool queryRenderer) {
+		memset(&data, 0, sizeof(data));
+		valid = false;
+		dirty = false;
+		checked = false;
+
+		path = cachePath();
+		if (path.empty())
+			return;
+
+		bool keyedByRenderer;
+		key = hashKey(display, screen, queryRenderer, keyedByRenderer);
+
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size == sizeof(data)) {
+			void *mapped = mmap(NULL, sizeof(data), PROT_READ, MAP_PRIVATE,
+					fd, 0);
+			if (mapped != MAP_FAILED) {
+				memcpy(&data, mapped, sizeof(data));
+				munmap(mapped, sizeof(data));
+			}
+		}
+		::close(fd);
+
+		valid = data.magic == GlxStartupCacheData::MAGIC &&
+				data.version == GlxStartupCacheData::VERSION &&
+				data.key == key;
+		if (!valid)
+			reset();
+		checked = keyedByRenderer;
+	}
+
+	bool isValid() {
+		return valid;
+	}
+
+	// false if the request wasn't seen before, or the record isn't checked
+	bool fbConfig (const GlxStartupCacheData::Attribs& request,
+			GlxStartupCacheData::Config& out)
+	{
+		if (!valid || !checked)
+			return false;
+		for (uint32_t i = 0; i < data.configCount; i++)
+			if (data.configs[i].request == request) {
+				out = data.configs[i];
+				return true;
+			}
+		return false;
+	}
+
+	void setFBConfig (const GlxStartupCacheData::Config& config) {
+		if (!valid)
+			reset();
+
+		uint32_t index = 0;
+		while (index < data.configCount &&
+				!(data.configs[index].request == config.request))
+			index++;
+		if (index == GlxStartupCacheData::MAX_CONFIGS)
+			return;
+		if (index < data.configCount && !memcmp(&data.configs[index],
+				&config, sizeof(config)))
+			return;
+		if (index == data.configCount)
+			data.configCount++;
+
+		data.configs[index] = config;
+		dirty = true;
+	}
+
+	bool contextVersion (int& major, int& minor) {
+		if (!valid || !checked || !data.contextMajor)
+			return false;
+		major = data.contextMajor;
+		minor = data.contextMinor;
+		return true;
+	}
+
+	void setContextVersion (int major, int minor) {
+		if (valid && data.contextMajor == major && data.contextMinor == minor)
+			return;
+		if (!valid)
+			reset();
+		data.contextMajor = major;
+		data.contextMinor = minor;
+		dirty = true;
+	}
+
+	// Call with a context current. Returns false if the record was written
+	// by another driver, it is dropped then and the caller records again
+	// what it probed, not what it took from the record.
+	bool validate (const char *renderer, const char *glVersion) {
+		if (!renderer || !glVersion)
+			return true;
+
+		const int n = GlxStartupCacheData::MAX_STRING - 1;
+		bool known = valid && data.renderer[0];
+		checked = true;
+		if (known && !strncmp(data.renderer, renderer, n) &&
+				!strncmp(data.glVersion, glVersion, n))
+			return true;
+
+		if (known || !valid)
+			reset();
+		strncpy(data.renderer, renderer, n);
+		strncpy(data.glVersion, glVersion, n);
+		dirty = true;
+		return !known;
+	}
+
+	void save() {
+		if (!dirty || path.empty())
+			return;
+		dirty = false;
+
+		std::string tmp = path + "." + std::to_string(getpid());
+		int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				0644);
+		if (fd < 0)
+			return;
+
+		bool ok = write(fd, &data, sizeof(data)) == sizeof(data);
+		::close(fd);
+		if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+			unlink(tmp.c_str());
+	}
+
+private:
+	GlxStartupCacheData data;
+	std::string path;
+	uint64_t key = 0;
+	bool valid = false;
+	bool dirty = false;
+	bool checked = false;	// the record is known to be from this driver
+
+	// a fresh record for the current key, it becomes the valid one
+	void reset() {
+		memset(&data, 0, sizeof(data));
+		data.magic = GlxStartupCacheData::MAGIC;
+		data.version = GlxStartupCacheData::VERSION;
+		data.key = key;
+		valid = true;
+	}
+
+	static std::string cachePath() {
+		const char *env = getenv("WINDOW_GLX_CACHE");
+		if (env)
+			return strcmp(env, "off") ? env : "";
+
+		const char *dir = getenv("XDG_CACHE_HOME");
+		if (dir && *dir)
+			return std::string(dir) + "/window-glx.cache";
+
+		const char *home = getenv("HOME");
+		if (!home || !*home)
+			return "";
+
+		std::string cache = std::string(home) + "/.cache";
+		mkdir(cache.c_str(), 0755);
+		return cache + "/window-glx.cache";
+	}
+
+	// FNV-1a over everything that identifies the server and the GLX driver.
+	// With GLX_MESA_query_renderer that includes the renderer and its
+	// version, asked without a context.
+	static uint64_t hashKey (Display *display, int screen, bool queryRenderer,
+			bool& keyedByRenderer)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&](const char *str) {
+			for (; str && *str; str++) {
+				hash ^= (uint8_t)*str;
+				hash *= 1099511628211ull;
+			}
+			hash ^= 0xff;
+			hash *= 1099511628211ull;
+		};
+
+		add(ServerVendor(display));
+		add(std::to_string(VendorRelease(display)).c_str());
+		add(glXGetClientString(display, GLX_VENDOR));
+		add(glXGetClientString(display, GLX_VERSION));
+		{
+			XStatsRoundTrip roundTrip;
+			add(glXQueryServerString(display, screen, GLX_VENDOR));
+		}
+		{
+			XStatsRoundTrip roundTrip;
+			add(glXQueryServerString(display, screen, GLX_VERSION));
+		}
+
+		keyedByRenderer = false;
+		if (!queryRenderer)
+			return hash;
+
+		auto queryString = (PFNGLXQUERYRENDERERSTRINGMESAPROC)
+				glXGetProcAddressARB(
+				(const GLubyte *)"glXQueryRendererStringMESA");
+		auto queryInteger = (PFNGLXQUERYRENDERERINTEGERMESAPROC)
+				glXGetProcAddressARB(
+				(const GLubyte *)"glXQueryRendererIntegerMESA");
+		unsigned int version[3];
+		const char *device;
+		if (queryString && queryInteger && (device = queryString(display,
+				screen, 0, GLX_RENDERER_DEVICE_ID_MESA)) &&
+				queryInteger(display, screen, 0, GLX_RENDERER_VERSION_MESA,
+				version))
+		{
+			add(device);
+			for (unsigned int part : version)
+				add(std::to_string(part).c_str());
+			keyedByRenderer = true;
+		}
+		return hash;
+	}
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef INPUT_CLOCK_H
+#define INPUT_CLOCK_H
+
+#include <mutex>
+#include <cstdint>
+#include <time.h>
+
+/*
+	Maps the X server time of the events, in milliseconds and wrapping every
+	49 days, to CLOCK_MONOTONIC nanoseconds of this process.
+
+	An event is always received after it happened, so the event that
+	arrived with the least delay gives the best estimate of the offset. The
+	estimate is lowered as soon as an event shows it was too high, and every
+	RESYNC_NS it is replaced by the best event of that period, so the drift
+	between the clocks doesn't pile up.
+*/
+class InputClock {
+public:
+	static const int64_t RESYNC_NS = 10000000000ll;
+
+	static int64_t now() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+	}
+
+	// on the input thread, for every event that has a time, when it is read
+	void observe (unsigned long serverTime, int64_t received) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!calibrated) {
+			reference = {serverTime, received};
+			best = reference;
+			epochStart = received;
+			calibrated = true;
+			return;
+		}
+
+		int64_t lag = received - predict(reference, serverTime);
+		if (lag < 0)
+			reference = {serverTime, received};
+		if (received - predict(best, serverTime) < 0 ||
+				best.received < epochStart)
+			best = {serverTime, received};
+
+		if (received - epochStart > RESYNC_NS) {
+			reference = best;
+			epochStart = received;
+		}
+	}
+
+	// from any thread, now() until the first event was observed
+	int64_t toMonotonic (unsigned long serverTime) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!calibrated)
+			return now();
+		return predict(reference, serverTime);
+	}
+
+private:
+	struct Sample {
+		unsigned long serverTime;
+		int64_t received;
+	};
+
+	std::mutex mutex;
+	bool calibrated = false;
+	Sample reference;
+	Sample best;			// of the current period
+	int64_t epochStart = 0;
+
+	// the server time is 32 bits, the difference is taken with its sign so
+	// a wrap between the two times doesn't matter
+	static int64_t predict (const Sample& sample, unsigned long serverTime) {
+		int32_t ms = (int32_t)(uint32_t)(serverTime - sample.serverTime);
+		return sample.received + ms * 1000000ll;
+	}
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef INPUT_EVENT_H
+#define INPUT_EVENT_H
+
+#include <cstdint>
+
+/*
+	One input event of a window, of any kind, small enough to be copied
+	through an SpscRing from the thread that handles the input to the ones
+	that use it. The member of the union that is set depends on type.
+*/
+struct InputEvent {
+	enum Type : uint8_t {
+		KEY,
+		BUTTON,		// 0 left, 1 middle, 2 right
+		MOTION,		// the motion of a drain coalesced, see Mouse
+		WHEEL,		// in notches
+		FOCUS,
+		RESIZE
+	};
+
+	struct Key {
+		int key;
+		bool press;
+		bool repeat;
+	};
+
+	struct Button {
+		int button;
+		bool press;
+	};
+
+	struct Motion {
+		float x;
+		float y;
+		float dx;
+		float dy;
+	};
+
+	struct Wheel {
+		float x;	// positive to the right
+		float y;	// positive away from the user
+	};
+
+	struct Focus {
+		bool in;
+	};
+
+	struct Resize {
+		int width;
+		int height;
+	};
+
+	Type type;
+	uint32_t serverTime;	// the window system's time, in milliseconds
+	int64_t time;			// CLOCK_MONOTONIC nanoseconds, 0 if unknown
+
+	union {
+		Key key;
+		Button button;
+		Motion motion;
+		Wheel wheel;
+		Focus focus;
+		Resize resize;
+	};
+
+	static InputEvent make (Type type, uint32_t serverTime = 0,
+			int64_t time = 0)
+	{
+		InputEvent event;
+		event.type = type;
+		event.serverTime = serverTime;
+		event.time = time;
+		return event;
+	}
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef INPUT_SNAPSHOT_H
+#define INPUT_SNAPSHOT_H
+
+#include <cstdint>
+#include "KeyBits.h"
+#include "Mouse.h"
+#include "InputEvent.h"
+#include "Span.h"
+
+/*
+	The input of a window for one frame, as it was at the end of a
+	handleInput(). It is only read, so any number of systems and threads
+	can ask it the same question and get the same answer, unlike
+	getOnceKeyState() and getOnceLmb() which change the state they read.
+
+	Only the keys that KeyBits holds are in it, the others read as up.
+*/
+struct InputSnapshot {
+	static const int MAX_EVENTS = 256;
+
+	uint64_t frame = 0;			// counts the handleInput() calls
+	int64_t time = 0;			// CLOCK_MONOTONIC nanoseconds of the drain
+
+	int width = 0;
+	int height = 0;
+	bool focus = false;
+
+	KeyBits keys;				// down at the end of the frame
+	KeyBits pressed;			// went down during the frame
+	KeyBits released;			// went up during the frame
+	MouseFrame mouse;
+
+	// the events of the frame in order, the ones past MAX_EVENTS are only
+	// counted
+	InputEvent events[MAX_EVENTS];
+	uint32_t eventCount = 0;
+	uint32_t droppedEvents = 0;
+
+	bool getKeyState (int key) const {
+		int index = KeyBits::index(key);
+		return index >= 0 && keys.test(index);
+	}
+
+	bool getPressed (int key) const {
+		int index = KeyBits::index(key);
+		return index >= 0 && pressed.test(index);
+	}
+
+	bool getReleased (int key) const {
+		int index = KeyBits::index(key);
+		return index >= 0 && released.test(index);
+	}
+
+	Span<const InputEvent> getEvents() const {
+		return Span<const InputEvent>(events, eventCount);
+	}
+
+	void addEvent (const InputEvent& event) {
+		if (eventCount < MAX_EVENTS)
+			events[eventCount++] = event;
+		else
+			droppedEvents++;
+	}
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef KEY_BITS_H
+#define KEY_BITS_H
+
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define KEY_BITS_SSE2
+#endif
+
+/*
+	One bit per key for the keys that are used the most, the codes are
+	packed in DENSE_KEYS bits:
+
+		0x0000 - 0x01ff		ascii and latin 1 keysyms, and on windows the
+							virtual keys that Keyboard stores as 256 + vk
+		0xfe00 - 0xffff		the keysyms of the function, cursor, keypad and
+							modifier keys
+
+	index() is -1 for the other codes, Keyboard keeps those apart.
+*/
+struct KeyBits {
+	static const int DENSE_KEYS = 1024;
+	static const int WORDS = DENSE_KEYS / 64;
+
+	alignas(16) uint64_t words[WORDS];
+
+	KeyBits() {
+		clear();
+	}
+
+	static constexpr int index (int key) {
+		if (key >= 0 && key < 0x200)
+			return key;
+		if (key >= 0xfe00 && key < 0x10000)
+			return 0x200 + key - 0xfe00;
+		return -1;
+	}
+
+	bool test (int index) const {
+		return (words[index >> 6] >> (index & 63)) & 1;
+	}
+
+	void set (int index, bool value) {
+		uint64_t bit = uint64_t(1) << (index & 63);
+		if (value)
+			words[index >> 6] |= bit;
+		else
+			words[index >> 6] &= ~bit;
+	}
+
+	void clear() {
+		memset(words, 0, sizeof(words));
+	}
+
+	/*
+		The edges of a frame: the keys whose state differs from the last
+		frame, plus the ones pressed and released again within the frame
+		(taps), which would otherwise cancel out.
+
+			changed = now ^ last
+			tapped = downs & ~now
+			pressed = (changed & now) | tapped
+			released = (changed & last) | tapped
+	*/
+	static void edges (const KeyBits& now, const KeyBits& last,
+			const KeyBits& downs, KeyBits& pressed, KeyBits& released)
+	{
+#ifdef KEY_BITS_SSE2
+		for (int i = 0; i < WORDS; i += 2) {
+			__m128i n = _mm_load_si128((const __m128i *)&now.words[i]);
+			__m128i l = _mm_load_si128((const __m128i *)&last.words[i]);
+			__m128i d = _mm_load_si128((const __m128i *)&downs.words[i]);
+
+			__m128i changed = _mm_xor_si128(n, l);
+			__m128i tapped = _mm_andnot_si128(n, d);
+			_mm_store_si128((__m128i *)&pressed.words[i],
+					_mm_or_si128(_mm_and_si128(changed, n), tapped));
+			_mm_store_si128((__m128i *)&released.words[i],
+					_mm_or_si128(_mm_and_si128(changed, l), tapped));
+		}
+#else
+		for (int i = 0; i < WORDS; i++) {
+			uint64_t changed = now.words[i] ^ last.words[i];
+			uint64_t tapped = downs.words[i] & ~now.words[i];
+			pressed.words[i] = (changed & now.words[i]) | tapped;
+			released.words[i] = (changed & last.words[i]) | tapped;
+		}
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef KEY_TABLE_H
+#define KEY_TABLE_H
+
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include "XStats.h"
+
+/*
+	The keymap of the display flattened to one keysym per keycode and
+	level, so translating a key event is one load:
+
+		level 0		no modifier
+		level 1		Shift, or Caps Lock on a letter, or Num Lock on the
+					keypad
+		level 2		AltGr (ISO_Level3_Shift or Mode_switch)
+		level 3		Shift and AltGr
+
+	A level the key doesn't have holds the keysym of the closest one it
+	has. The table is for the active XKB group, it is built again when the
+	mapping or the group changes. The windows copy it, see Table.
+*/
+class KeyTable {
+public:
+	static const int KEYCODES = 256;
+	static const int LEVELS = 4;
+
+	struct Table {
+		enum Flags : uint8_t {
+			KEYPAD = 1,		// Num Lock selects level 1
+			ALPHA = 2		// Caps Lock selects level 1
+		};
+
+		uint32_t syms[KEYCODES][LEVELS];
+		uint8_t flags[KEYCODES];
+		unsigned int level3Mask;
+		unsigned int numLockMask;
+
+		KeySym lookup (unsigned int keycode, unsigned int state) const {
+			keycode &= KEYCODES - 1;
+			bool shift = state & ShiftMask;
+			if ((state & numLockMask) && (flags[keycode] & KEYPAD))
+				shift = !shift;
+			else if ((state & LockMask) && (flags[keycode] & ALPHA))
+				shift = !shift;
+			int level = shift + (state & level3Mask ? 2 : 0);
+			return syms[keycode][level];
+		}
+	};
+
+	// selects the XKB events that change the table, and builds it
+	void init (Display *display) {
+		this->display = display;
+
+		int opcode, error, major = XkbMajorVersion, minor = XkbMinorVersion;
+		{
+			XStatsRoundTrip roundTrip;
+			xkb = XkbQueryExtension(display, &opcode, &xkbEventBase, &error,
+					&major, &minor);
+		}
+		if (xkb) {
+			XkbSelectEvents(display, XkbUseCoreKbd,
+					XkbNewKeyboardNotifyMask | XkbMapNotifyMask,
+					XkbNewKeyboardNotifyMask | XkbMapNotifyMask);
+			XkbSelectEventDetails(display, XkbUseCoreKbd, XkbStateNotify,
+					XkbGroupStateMask, XkbGroupStateMask);
+		}
+		build();
+	}
+
+	// On the input thread. True if the event is about the keymap, it
+	// belongs to no window then.
+	bool handleEvent (XEvent& event) {
+		if (event.type == MappingNotify) {
+			XRefreshKeyboardMapping(&event.xmapping);
+			if (event.xmapping.request != MappingPointer)
+				build();
+			return true;
+		}
+		if (!xkb || event.type != xkbEventBase)
+			return false;
+
+		const XkbEvent& xkbEvent = (const XkbEvent&)event;
+		switch (xkbEvent.any.xkb_type) {
+			case XkbMapNotify:
+				{
+					XStatsRoundTrip roundTrip;
+					XkbRefreshKeyboardMapping((XkbMapNotifyEvent *)&event);
+				}
+				build();
+				break;
+			case XkbNewKeyboardNotify:
+				build();
+				break;
+			case XkbStateNotify:
+				if (xkbEvent.state.group != group)
+					build();
+				break;
+		}
+		return true;
+	}
+
+	// changes every time the table is built
+	uint32_t generation() const {
+		return generationCount.load(std::memory_order_acquire);
+	}
+
+	// from any thread, the generation of the copy goes to copyGeneration
+	void copy (Table& out, uint32_t& copyGeneration) {
+		std::lock_guard<std::mutex> lock(mutex);
+		out = table;
+		copyGeneration = generationCount.load(std::memory_order_relaxed);
+	}
+
+private:
+	Display *display = NULL;
+	bool xkb = false;
+	int xkbEventBase = 0;
+	int group = 0;
+
+	std::mutex mutex;
+	Table table;
+	std::atomic<uint32_t> generationCount{0};
+
+	// the modifier bits that the keys with the keysym are mapped to
+	static unsigned int modifierMask (Display *display,
+			const XModifierKeymap *modifiers, KeySym sym)
+	{
+		unsigned int mask = 0;
+		for (int mod = 0; mod < 8; mod++)
+			for (int i = 0; i < modifiers->max_keypermod; i++) {
+				KeyCode keycode = modifiers->modifiermap[
+						mod * modifiers->max_keypermod + i];
+				if (keycode && XkbKeycodeToKeysym(display, keycode, 0, 0) == sym)
+					mask |= 1 << mod;
+			}
+		return mask;
+	}
+
+	void build() {
+		XStatsScope stats("KeyTable");
+		Table built;
+		memset(&built, 0, sizeof(built));
+
+		group = 0;
+		XkbStateRec state;
+		if (xkb) {
+			XStatsRoundTrip roundTrip;
+			if (XkbGetState(display, XkbUseCoreKbd, &state) == Success)
+				group = state.group;
+		}
+
+		int minKeycode, maxKeycode;
+		XDisplayKeycodes(display, &minKeycode, &maxKeycode);
+		for (int keycode = minKeycode; keycode <= maxKeycode &&
+				keycode < KEYCODES; keycode++)
+		{
+			uint32_t *syms = built.syms[keycode];
+			for (int level = 0; level < LEVELS; level++)
+				syms[level] = XkbKeycodeToKeysym(display, keycode, group,
+						level);
+
+			// the missing levels fall back to the ones without AltGr, then
+			// to the ones without Shift
+			for (int level = 1; level < LEVELS; level++)
+				if (syms[level] == NoSymbol)
+					syms[level] = syms[level & 2 ? level - 2 : 0];
+
+			KeySym lower, upper;
+			XConvertCase(syms[0], &lower, &upper);
+			if (lower != upper && syms[0] == lower && syms[1] == upper)
+				built.flags[keycode] |= Table::ALPHA;
+			if (IsKeypadKey(syms[1]))
+				built.flags[keycode] |= Table::KEYPAD;
+		}
+
+		XModifierKeymap *modifiers;
+		{
+			XStatsRoundTrip roundTrip;
+			modifiers = XGetModifierMapping(display);
+		}
+		if (modifiers) {
+			built.level3Mask = modifierMask(display, modifiers,
+					XK_ISO_Level3_Shift) |
+					modifierMask(display, modifiers, XK_Mode_switch);
+			built.numLockMask = modifierMask(display, modifiers, XK_Num_Lock);
+			XFreeModifiermap(modifiers);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		table = built;
+		generationCount.fetch_add(1, std::memory_order_release);
+	}
+};
+
+#endif
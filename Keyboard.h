@@ -1,81 +1,288 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
-#include <map>
+#include <array>
+#include <cstdint>
+#include <string_view>
 #include "Util.h"
+#include "SpscRing.h"
+#include "KeyBits.h"
+
+constexpr std::array<char, 129> makeAsciiNames() {
+	std::array<char, 129> ascii = {};
+	for (int i = 0; i < 129; i++)
+		ascii[i] = char(i);
+	return ascii;
+}
+
+/*
+	The keys that aren't ascii have a name each, a platform gives their
+	codes in this order to makeKeyMap(), at compile time:
+
+		static constexpr KeyMap keyMap = makeKeyMap({XK_Return, ...});
+
+	Codes that aren't mapped are -1. The map is shared by all the windows
+	and finds the name of a code with one load.
+*/
+struct KeyNames {
+	static constexpr int COUNT = 42;
+
+	static constexpr const char *names[COUNT] = {
+		"ENTER", "SPACE", "CAPS_LOCK", "TAB", "L_ALT", "R_ALT", "L_CTRL",
+		"R_CTRL", "L_SHIFT", "R_SHIFT", "ARROW_UP", "ARROW_DOWN",
+		"ARROW_LEFT", "ARROW_RIGHT", "F1", "F2", "F3", "F4", "F5", "F6",
+		"F7", "F8", "F9", "F10", "F11", "F12", "BACKSPACE", "INSERT",
+		"DELETE", "HOME", "PAGE_UP", "PAGE_DOWN", "END", "PRINT_SCREEN",
+		"SCREEN_LOCK", "PAUSE", "NUM_LOCK", "NUM_ENTER", "NUM_INSERT",
+		"WINKEY", "FN", "ESC"
+	};
+
+	// the names of the ascii codes are the characters themselves
+	static constexpr std::array<char, 129> ascii = makeAsciiNames();
+};
+
+struct KeyMap {
+	static const uint8_t NONE = 0xff;
+
+	int codes[KeyNames::COUNT];
+	uint8_t names[KeyBits::DENSE_KEYS];	// by KeyBits::index() of the code
+};
+
+// the first name given to a code is kept
+constexpr KeyMap makeKeyMap (const int (&codes)[KeyNames::COUNT]) {
+	KeyMap map = {};
+	for (int i = 0; i < KeyBits::DENSE_KEYS; i++)
+		map.names[i] = KeyMap::NONE;
+	for (int i = 0; i < KeyNames::COUNT; i++) {
+		map.codes[i] = codes[i];
+		int index = KeyBits::index(codes[i]);
+		if (index >= 0 && map.names[index] == KeyMap::NONE)
+			map.names[index] = i;
+	}
+	return map;
+}
 
 struct KeyEvent {
 	int key;
 	int press;
+	bool repeat;			// a press sent again while the key is held
+	uint32_t serverTime;	// the window system's time, in milliseconds
+	int64_t time;			// CLOCK_MONOTONIC nanoseconds, 0 if unknown
 
-	KeyEvent (int key = -1, int press = 0)
-	: key(key), press(press) {}
+	KeyEvent (int key = -1, int press = 0, uint32_t serverTime = 0,
+			int64_t time = 0, bool repeat = false)
+	: key(key), press(press), repeat(repeat), serverTime(serverTime),
+			time(time) {}
 };
 
+// QUE_SIZE is a power of two, the queue holds QUE_SIZE - 1 events and the
+// ones that don't fit are counted in events.overflows()
 template <int QUE_SIZE = 256>
-class Keyboard : public Util::StaticQueue <KeyEvent, QUE_SIZE> {
+class Keyboard {
 public:
 	const static int MAX_KEY_CODE = 65536;
 
-	int keyState[MAX_KEY_CODE];
-	int onceKeyState[MAX_KEY_CODE];
-	int keyNoCase[MAX_KEY_CODE];
-	std::map<std::string, int> currentKeyMap;
+	SpscRing<KeyEvent, QUE_SIZE> events;
 
-	Keyboard() {
-		for (int i = 0; i < MAX_KEY_CODE; ++i) {
-			keyState[i] = 0;
-			keyNoCase[i] = 0;
-			onceKeyState[i] = false;
+	// a repeat is only queued, the key is already down
+	void registerEvent (int key, int press, uint32_t serverTime = 0,
+			int64_t time = 0, bool repeat = false)
+	{
+		if (repeat) {
+			events.push(KeyEvent(key, true, serverTime, time, true));
+			return;
+		}
+
+		int index = KeyBits::index(key);
+		if (index >= 0) {
+			keyState.set(index, press);
+			keyNoCase.set(KeyBits::index(lower(key)), press);
+			if (press)
+				downs.set(index, true);
+			else
+				onceKeyState.set(index, false);
 		}
+		else if (RareKey *rare = findRare(key, press)) {
+			rare->down = press;
+			if (press)
+				rare->downs = true;
+			else
+				rare->once = false;
+		}
+		events.push(KeyEvent(key, press, serverTime, time));
 	}
 
-	void registerEvent (int key, int press) {
-		if (press) {
-			keyState[key] = true;
-			keyNoCase[std::tolower(key)] = true;
+	// the keys pressed and released during the last frame are summed from
+	// here, the windows call both around each handleInput()
+	void beginFrame() {
+		lastKeyState = keyState;
+		downs.clear();
+		for (int i = 0; i < rareCount; i++) {
+			rareKeys[i].last = rareKeys[i].down;
+			rareKeys[i].downs = false;
 		}
-		else {
-			keyState[key] = false;
-			keyNoCase[std::tolower(key)] = false;
-			onceKeyState[key] = false;
+	}
+
+	void endFrame() {
+		KeyBits::edges(keyState, lastKeyState, downs, pressed, released);
+		for (int i = 0; i < rareCount; i++) {
+			RareKey& rare = rareKeys[i];
+			bool tapped = rare.downs && !rare.down;
+			rare.pressed = (rare.down && !rare.last) || tapped;
+			rare.released = (!rare.down && rare.last) || tapped;
 		}
-		Util::StaticQueue <KeyEvent, QUE_SIZE>::insert(KeyEvent(key, press));
+	}
+
+	// the state as bits, for the keys that KeyBits holds
+	const KeyBits& getKeyBits() const {
+		return keyState;
+	}
+
+	const KeyBits& getPressedBits() const {
+		return pressed;
+	}
+
+	const KeyBits& getReleasedBits() const {
+		return released;
+	}
+
+	// went down during the last frame, even if it is already up again
+	bool getPressed (int key) const {
+		int index = KeyBits::index(key);
+		if (index >= 0)
+			return pressed.test(index);
+		const RareKey *rare = findRare(key);
+		return rare && rare->pressed;
+	}
+
+	bool getReleased (int key) const {
+		int index = KeyBits::index(key);
+		if (index >= 0)
+			return released.test(index);
+		const RareKey *rare = findRare(key);
+		return rare && rare->released;
 	}
 
 	int getStateNoCase (int key) {
-		if (key < 0 || key >= MAX_KEY_CODE)
-			return false;
-		return keyNoCase[std::tolower(key)];
+		int index = KeyBits::index(lower(key));
+		if (index >= 0)
+			return keyNoCase.test(index);
+		return getKeyState(key);
 	}
 
 	int getKeyState (int key) {
-		if (key < 0 || key >= MAX_KEY_CODE)
-			return false;
-		return keyState[key];
+		int index = KeyBits::index(key);
+		if (index >= 0)
+			return keyState.test(index);
+		const RareKey *rare = findRare(key);
+		return rare && rare->down;
 	}
 
 	int getOnceKeyState (int key) {
-		if (!onceKeyState[key] && keyState[key]) {
-			onceKeyState[key] = true;
+		int index = KeyBits::index(key);
+		if (index < 0)
+			return getOnceRare(key);
+
+		if (!onceKeyState.test(index) && keyState.test(index)) {
+			onceKeyState.set(index, true);
 			return true;
 		}
 		else {
-			if (!keyState[key])
-				onceKeyState[key] = false;
+			if (!keyState.test(index))
+				onceKeyState.set(index, false);
 			return false;
 		}
 	}
 
+	// a KeyEvent with key -1 if the queue is empty
 	KeyEvent popEvent() {
-		return Util::StaticQueue <KeyEvent, QUE_SIZE>::pop();
+		KeyEvent event;
+		events.pop(event);
+		return event;
 	}
 
 	bool queEmpty() {
-		return Util::StaticQueue <KeyEvent, QUE_SIZE>::empty();
+		return events.empty();
+	}
+
+	// the queued events, oldest first, as many as fit in out
+	size_t drainEvents (Span<KeyEvent> out) {
+		return events.drain(out);
+	}
+
+private:
+	// the keys outside of KeyBits, a few at a time in practice
+	struct RareKey {
+		int key;
+		bool down;
+		bool last;
+		bool once;
+		bool downs;
+		bool pressed;
+		bool released;
+	};
+	static const int MAX_RARE_KEYS = 16;
+
+	KeyBits keyState;
+	KeyBits lastKeyState;
+	KeyBits onceKeyState;
+	KeyBits keyNoCase;
+	KeyBits downs;
+	KeyBits pressed;
+	KeyBits released;
+	RareKey rareKeys[MAX_RARE_KEYS];
+	int rareCount = 0;
+
+	static int lower (int key) {
+		return key >= 'A' && key <= 'Z' ? key - 'A' + 'a' : key;
+	}
+
+	const RareKey *findRare (int key) const {
+		for (int i = 0; i < rareCount; i++)
+			if (rareKeys[i].key == key)
+				return &rareKeys[i];
+		return NULL;
+	}
+
+	// a press takes a free entry, one of a key that is up and has no edge
+	// left is reused if they are all taken
+	RareKey *findRare (int key, bool press) {
+		if (const RareKey *rare = findRare(key))
+			return const_cast<RareKey *>(rare);
+		if (!press)
+			return NULL;
+
+		int index = rareCount;
+		if (rareCount < MAX_RARE_KEYS) {
+			rareCount++;
+		}
+		else {
+			for (index = 0; index < MAX_RARE_KEYS; index++) {
+				const RareKey& rare = rareKeys[index];
+				if (!rare.down && !rare.last && !rare.downs)
+					break;
+			}
+			if (index == MAX_RARE_KEYS)
+				return NULL;
+		}
+		rareKeys[index] = {key, false, false, false, false, false, false};
+		return &rareKeys[index];
+	}
+
+	int getOnceRare (int key) {
+		RareKey *rare = const_cast<RareKey *>(findRare(key));
+		if (!rare)
+			return false;
+		if (!rare->once && rare->down) {
+			rare->once = true;
+			return true;
+		}
+		if (!rare->down)
+			rare->once = false;
+		return false;
 	}
 
-	static std::string nonAsciiKeys[];
+public:
 
 	int ENTER;
 	int SPACE;
@@ -120,127 +327,69 @@ public:
 	int FN;
 	int ESC;
 
-	void mapKeys (const std::map<std::string, int>& mapping) {
-		auto getCode = [&](std::string strCode) -> int {
-			if (mapping.find(strCode) != mapping.end())
-				return (*mapping.find(strCode)).second;
-			else
-				return -1;
-		};
-
-		currentKeyMap = mapping;
-
-		ENTER = getCode("ENTER");
-		SPACE = getCode("SPACE");
-		CAPS_LOCK = getCode("CAPS_LOCK");
-		TAB = getCode("TAB");
-		L_ALT = getCode("L_ALT");
-		R_ALT = getCode("R_ALT");
-		L_CTRL = getCode("L_CTRL");
-		R_CTRL = getCode("R_CTRL");
-		L_SHIFT = getCode("L_SHIFT");
-		R_SHIFT = getCode("R_SHIFT");
-		ARROW_UP = getCode("ARROW_UP");
-		ARROW_DOWN = getCode("ARROW_DOWN");
-		ARROW_LEFT = getCode("ARROW_LEFT");
-		ARROW_RIGHT = getCode("ARROW_RIGHT");
-		F1 = getCode("F1");
-		F2 = getCode("F2");
-		F3 = getCode("F3");
-		F4 = getCode("F4");
-		F5 = getCode("F5");
-		F6 = getCode("F6");
-		F7 = getCode("F7");
-		F8 = getCode("F8");
-		F9 = getCode("F9");
-		F10 = getCode("F10");
-		F11 = getCode("F11");
-		F12 = getCode("F12");
-		BACKSPACE = getCode("BACKSPACE");
-		INSERT = getCode("INSERT");
-		DELETE = getCode("DELETE");
-		HOME = getCode("HOME");
-		PAGE_UP = getCode("PAGE_UP");
-		PAGE_DOWN = getCode("PAGE_DOWN");
-		END = getCode("END");
-		PRINT_SCREEN = getCode("PRINT_SCREEN");
-		SCREEN_LOCK = getCode("SCREEN_LOCK");
-		PAUSE = getCode("PAUSE");
-		NUM_LOCK = getCode("NUM_LOCK");
-		NUM_ENTER = getCode("NUM_ENTER");
-		NUM_INSERT = getCode("NUM_INSERT");
-		WINKEY = getCode("WINKEY");
-		FN = getCode("FN");
-		ESC = getCode("ESC");
-	}
-
-	std::string getName (int code) {
-		for (auto&& pair : currentKeyMap) {
-			if (pair.second == code)
-				return pair.first;
-		}
+	// the codes of the platform, in the order of KeyNames::names
+	void mapKeys (const KeyMap& map) {
+		const int *codes = map.codes;
+		keyMap = &map;
 
-		if (0 <= code && code <= 128) {
-			return std::string() + char(code);
-		}
+		ENTER = codes[0];
+		SPACE = codes[1];
+		CAPS_LOCK = codes[2];
+		TAB = codes[3];
+		L_ALT = codes[4];
+		R_ALT = codes[5];
+		L_CTRL = codes[6];
+		R_CTRL = codes[7];
+		L_SHIFT = codes[8];
+		R_SHIFT = codes[9];
+		ARROW_UP = codes[10];
+		ARROW_DOWN = codes[11];
+		ARROW_LEFT = codes[12];
+		ARROW_RIGHT = codes[13];
+		F1 = codes[14];
+		F2 = codes[15];
+		F3 = codes[16];
+		F4 = codes[17];
+		F5 = codes[18];
+		F6 = codes[19];
+		F7 = codes[20];
+		F8 = codes[21];
+		F9 = codes[22];
+		F10 = codes[23];
+		F11 = codes[24];
+		F12 = codes[25];
+		BACKSPACE = codes[26];
+		INSERT = codes[27];
+		DELETE = codes[28];
+		HOME = codes[29];
+		PAGE_UP = codes[30];
+		PAGE_DOWN = codes[31];
+		END = codes[32];
+		PRINT_SCREEN = codes[33];
+		SCREEN_LOCK = codes[34];
+		PAUSE = codes[35];
+		NUM_LOCK = codes[36];
+		NUM_ENTER = codes[37];
+		NUM_INSERT = codes[38];
+		WINKEY = codes[39];
+		FN = codes[40];
+		ESC = codes[41];
+	}
+
+	// never allocates, the views point to static storage
+	std::string_view getName (int code) const {
+		int index = KeyBits::index(code);
+		if (keyMap && index >= 0 && keyMap->names[index] != KeyMap::NONE)
+			return KeyNames::names[keyMap->names[index]];
+
+		if (0 <= code && code <= 128)
+			return std::string_view(&KeyNames::ascii[code], 1);
 
 		return "NOT_FOUND";
 	}
-};
 
-template <int QUE_SIZE>
-std::string Keyboard<QUE_SIZE>::nonAsciiKeys[] = {
-	"ENTER", "SPACE", "CAPS_LOCK", "TAB", "L_ALT", "R_ALT", "L_CTRL",
-	"R_CTRL", "L_SHIFT", "R_SHIFT", "ARROW_UP", "ARROW_DOWN", "ARROW_LEFT",
-	"ARROW_RIGHT", "F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10",
-	"F11", "F12", "BACKSPACE", "INSERT", "DELETE", "HOME", "PAGE_UP",
-	"PAGE_DOWN", "END", "PRINT_SCREEN", "SCREEN_LOCK", "PAUSE", "NUM_LOCK",
-	"NUM_ENTER", "NUM_INSERT", "WINKEY", "FN", "ESC"
+private:
+	const KeyMap *keyMap = NULL;
 };
 
-	// example of mapping:
-	
-	// mapping["ENTER"] = 1;
-	// mapping["SPACE"] = 2;
-	// mapping["CAPS_LOCK"] = 3;
-	// mapping["TAB"] = 4;
-	// mapping["L_ALT"] = 5;
-	// mapping["R_ALT"] = 6;
-	// mapping["L_CTRL"] = 8;
-	// mapping["R_CTRL"] = 9;
-	// mapping["L_SHIFT"] = 10;
-	// mapping["R_SHIFT"] = 11;
-	// mapping["ARROW_UP"] = 12;
-	// mapping["ARROW_DOWN"] = 13;
-	// mapping["ARROW_LEFT"] = 14;
-	// mapping["ARROW_RIGHT"] = 15;
-	// mapping["F1"] = 16;
-	// mapping["F2"] = 17;
-	// mapping["F3"] = 18;
-	// mapping["F4"] = 19;
-	// mapping["F5"] = 20;
-	// mapping["F6"] = 21;
-	// mapping["F7"] = 22;
-	// mapping["F8"] = 23;
-	// mapping["F9"] = 24;
-	// mapping["F10"] = 25;
-	// mapping["F11"] = 26;
-	// mapping["F12"] = 27;
-	// mapping["BACKSPACE"] = 28;
-	// mapping["INSERT"] = 29;
-	// mapping["DELETE"] = 30;
-	// mapping["HOME"] = 31;
-	// mapping["PAGE_UP"] = 32;
-	// mapping["PAGE_DOWN"] = 33;
-	// mapping["END"] = 34;
-	// mapping["PRINT_SCREEN"] = 35;
-	// mapping["SCREEN_LOCK"] = 36;
-	// mapping["PAUSE"] = 37;
-	// mapping["NUM_LOCK"] = 38;
-	// mapping["NUM_ENTER"] = 39;
-	// mapping["NUM_INSERT"] = 40;
-	// mapping["WINKEY"] = 41;
-	// mapping["FN"] = 42;
-	// mapping["ESC"] = 43;
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,239 @@
+#ifndef LINUX_DISPLAY_H
+#define LINUX_DISPLAY_H
+
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <cstdlib>
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <GL/glx.h>
+#include "TaskQueue.h"
+#include "XStats.h"
+#include "FBConfig.h"
+#include "GlxStartupCache.h"
+#include "Extensions.h"
+#include "XInputPointer.h"
+#include "InputClock.h"
+#include "KeyTable.h"
+
+// One connection to the X server shared by every window of the process.
+// Windows acquire() it when they are created and release() it when they
+// close, the connection is closed together with the last window.
+class LinuxDisplay {
+public:
+	Display *display;
+	xcb_connection_t *connection;
+	int screen;
+	Window root;
+
+	int glxMajor = 0;
+	int glxMinor = 0;
+	const char *glxExts;
+
+	Atom wm_protocols;
+	Atom wm_delete_window;
+
+	// signaled by wake(), polled by the event loop next to the X socket
+	int wakeFd;
+	TaskQueue tasks;
+
+	FBConfigCache fbConfigs;
+	GlxStartupCache startupCache;
+
+	GlxExtensionSet glxExtensions;
+
+	// the windows that use XInput2, and the one with the keyboard focus
+	// that gets the raw motion, seen from the input thread
+	XInputPointer xinput;
+	Window focusWindow = None;
+
+	// the server time of the events to CLOCK_MONOTONIC
+	InputClock clock;
+
+	// the keymap, kept up to date by the input thread
+	KeyTable keyTable;
+
+	// a held key repeats its KeyPress without the KeyRelease in between,
+	// else the dispatcher drops the releases that are part of a repeat
+	bool detectableRepeat = false;
+
+	// hidden context that owns the objects shared by all windows, created
+	// by the first window that uses LinuxWindow::shareRoot
+	GLXContext rootContext = 0;
+
+	// the context used by all the windows in LinuxWindow::singleContext mode
+	GLXContext singleContext = 0;
+	GLXFBConfig singleContextConfig = 0;
+
+	static LinuxDisplay *acquire() {
+		std::lock_guard<std::mutex> lock(refMutex());
+		LinuxDisplay *shared = instance().load(std::memory_order_relaxed);
+
+		if (!shared) {
+			shared = new LinuxDisplay();
+			instance().store(shared, std::memory_order_release);
+		}
+		shared->refCount++;
+		return shared;
+	}
+
+	// the shared connection, or NULL if no window holds it
+	static LinuxDisplay *get() {
+		return instance().load(std::memory_order_acquire);
+	}
+
+	static void release() {
+		std::lock_guard<std::mutex> lock(refMutex());
+		LinuxDisplay *shared = instance().load(std::memory_order_relaxed);
+
+		if (!shared)
+			return;
+		if (--shared->refCount == 0) {
+			instance().store(NULL, std::memory_order_release);
+			delete shared;
+		}
+	}
+
+	// Wake and post from any thread, also while the last window closes.
+	// They hold the lock release() deletes the display under, and do
+	// nothing if there is no display, a posted func is dropped then.
+	static void wakeShared() {
+		std::lock_guard<std::mutex> lock(refMutex());
+		LinuxDisplay *shared = instance().load(std::memory_order_relaxed);
+		if (shared)
+			shared->wake();
+	}
+
+	static void postShared (std::function<void()> func) {
+		std::lock_guard<std::mutex> lock(refMutex());
+		LinuxDisplay *shared = instance().load(std::memory_order_relaxed);
+		if (shared)
+			shared->post(std::move(func));
+	}
+
+	void wake() {
+		uint64_t one = 1;
+		ssize_t ret = write(wakeFd, &one, sizeof(one));
+		(void)ret;	// the counter can only be full if a wake is pending
+	}
+
+	void post (std::function<void()> func) {
+		tasks.post(std::move(func));
+		wake();
+	}
+
+	void clearWake() {
+		uint64_t count;
+		ssize_t ret = read(wakeFd, &count, sizeof(count));
+		(void)ret;
+	}
+
+	LinuxDisplay (const LinuxDisplay& other) = delete;
+	LinuxDisplay (const LinuxDisplay&& other) = delete;
+	LinuxDisplay& operator = (const LinuxDisplay& other) = delete;
+	LinuxDisplay& operator = (const LinuxDisplay&& other) = delete;
+
+private:
+	int refCount = 0;
+
+	static std::mutex& refMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::atomic<LinuxDisplay *>& instance() {
+		static std::atomic<LinuxDisplay *> shared{NULL};
+		return shared;
+	}
+
+	LinuxDisplay() {
+		XStatsScope stats("LinuxDisplay");
+
+		// the windows may be used from more than one thread, this has to be
+		// the first Xlib call of the process to have any effect
+		XInitThreads();
+
+		if ((display = XOpenDisplay(NULL)) == NULL)
+			throw std::runtime_error("Can't connect to X server");
+		XStats::get().setDisplay(display);
+
+		// Xlib stays the owner of the event queue, the xcb side of the
+		// connection is used for the requests that don't involve GLX
+		connection = XGetXCBConnection(display);
+		screen = DefaultScreen(display);
+		root = RootWindow(display, screen);
+
+		// all the atoms are fetched in a single round trip
+		const char *atomNames[] = {
+			"WM_PROTOCOLS",
+			"WM_DELETE_WINDOW"
+		};
+		const int atomCount = sizeof(atomNames) / sizeof(atomNames[0]);
+		xcb_intern_atom_cookie_t cookies[atomCount];
+		Atom atoms[atomCount];
+
+		for (int i = 0; i < atomCount; i++)
+			cookies[i] = xcb_intern_atom(connection, 0,
+					strlen(atomNames[i]), atomNames[i]);
+		XStats::get().sentXcb(cookies[atomCount - 1].sequence);
+		{
+			XStatsRoundTrip roundTrip;
+			for (int i = 0; i < atomCount; i++) {
+				xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+						connection, cookies[i], NULL);
+				atoms[i] = reply ? reply->atom : None;
+				free(reply);
+			}
+		}
+
+		wm_protocols = atoms[0];
+		wm_delete_window = atoms[1];
+
+		keyTable.init(display);
+
+		Bool repeatSupported = False;
+		{
+			XStatsRoundTrip roundTrip;
+			detectableRepeat = XkbSetDetectableAutoRepeat(display, True,
+					&repeatSupported) && repeatSupported;
+		}
+
+		// the same for every window, so asked only once
+		{
+			XStatsRoundTrip roundTrip;
+			if (!glXQueryVersion(display, &glxMajor, &glxMinor))
+				glxMajor = glxMinor = 0;
+		}
+		{
+			XStatsRoundTrip roundTrip;
+			glxExts = glXQueryExtensionsString(display, screen);
+		}
+		glxExtensions.setString(glxExts);
+		startupCache.load(display, screen,
+				glxExtensions.has(GlxExt::MESA_query_renderer));
+		fbConfigs.setDisplay(display, screen, root, &startupCache);
+
+		if ((wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+			XStats::get().setDisplay(NULL);
+			XCloseDisplay(display);
+			throw std::runtime_error("Can't create the wake eventfd");
+		}
+	}
+
+	~LinuxDisplay() {
+		::close(wakeFd);
+		if (singleContext)
+			glXDestroyContext(display, singleContext);
+		if (rootContext)
+			glXDestroyContext(display, rootContext);
+		fbConfigs.clear();
+		XStats::get().setDisplay(NULL);
+		XCloseDisplay(display);
+	}
+};
+
+#endif
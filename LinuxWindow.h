@@ -3,51 +3,69 @@
 
 #include "Keyboard.h"
 #include "Mouse.h"
+#include "LinuxDisplay.h"
+#include "XStats.h"
+#include "SpscRing.h"
+#include "Span.h"
+#include "InputEvent.h"
+#include "InputSnapshot.h"
+#include "Seqlock.h"
 #include <cstring>
+#include <cerrno>
+#include <poll.h>
 #include <sstream>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <functional>
+#include <unordered_map>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/glx.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/XKBlib.h>
 
 #define GLX_CONTEXT_MAJOR_VERSION_ARB       0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB       0x2092
 
-// Helper to check for extension string presence.  Adapted from:
-//   http://www.opengl.org/resources/features/OGLextensions/
-static bool isExtensionSupported(const char *extList, const char *extension)
-{
-	const char *start;
-	const char *where, *terminator;
-
-	/* Extension names should not have spaces. */
-	where = strchr(extension, ' ');
-	if (where || *extension == '\0')
-		return false;
+// What the calling thread has current, as far as the windows know. The
+// windows skip glXMakeCurrent when nothing would change, call forget() after
+// making a context current without them.
+struct GlxCurrent {
+	Display *display = NULL;
+	GLXDrawable drawable = None;
+	GLXContext context = 0;
 
-	/* It takes a bit of care to be fool-proof about parsing the
-	   OpenGL extensions string. Don't be fooled by sub-strings,
-	   etc. */
-	for (start=extList;;) {
-		where = strstr(start, extension);
+	uint64_t switches = 0;	// glXMakeCurrent calls done by the windows
+	uint64_t elided = 0;	// calls skipped because it was already current
 
-		if (!where)
-			break;
-
-		terminator = where + strlen(extension);
+	static GlxCurrent& get() {
+		static thread_local GlxCurrent current;
+		return current;
+	}
 
-		if ( where == start || *(where - 1) == ' ' )
-			if ( *terminator == ' ' || *terminator == '\0' )
-				return true;
+	bool isCurrent (Display *display, GLXDrawable drawable,
+			GLXContext context)
+	{
+		return this->display == display && this->drawable == drawable &&
+				this->context == context;
+	}
 
-		start = terminator;
+	void set (Display *display, GLXDrawable drawable, GLXContext context) {
+		this->display = display;
+		this->drawable = drawable;
+		this->context = context;
 	}
 
-	return false;
-}
+	void forget() {
+		set(NULL, None, 0);
+	}
+};
 
-static bool ctxErrorOccurred = false;
+// the X error handler is global, so only one context is created at a time
+static std::mutex ctxCreateMutex;
+static std::atomic<bool> ctxErrorOccurred{false};
 static int ctxErrorHandler( Display *dpy, XErrorEvent *ev )
 {
 	ctxErrorOccurred = true;
@@ -57,14 +75,56 @@ static int ctxErrorHandler( Display *dpy, XErrorEvent *ev )
 // 2 x TO_DO
 class LinuxWindow {
 public:
+	LinuxDisplay *shared;
 	Display *display;
+	xcb_connection_t *connection;
 	Window parrentWindow; 
 	Window window;
 
 	Colormap colormap; 
 	XVisualInfo *visualInfo;
+	GLXFBConfig fbconfig;
+	GlExtensionSet glExtensions;
+	int contextMajor = 3;
+	int contextMinor = 0;
+	bool contextProbed = false;	// the version was tried, not read from the
+								// startup cache
+	int swapInterval = -1;	// -1 until set by setVSync()
+
+	// The motion events of a drain move the mouse once, to the last
+	// position. Every position is kept only if keepMotionHistory is set.
+	static const size_t MAX_MOTION_HISTORY = 1024;
+	bool motionPending = false;
+	float motionX = 0;
+	float motionY = 0;
+	std::vector<MotionSample> motionHistory;	// of the last frame
+	std::vector<MotionSample> frameMotion;		// of the frame being summed
+	uint32_t motionDropped = 0;			// samples thinned out, last frame
+	uint32_t frameMotionDropped = 0;
+
+	// events from the input thread, only used with a render thread
+	static const size_t INPUT_RING_SIZE = 1024;
+	std::unique_ptr<SpscRing<XEvent, INPUT_RING_SIZE>> inputRing;
+
+	// every input event of the window, only after recordEvents()
+	static const size_t EVENT_RING_SIZE = 1024;
+	std::unique_ptr<SpscRing<InputEvent, EVENT_RING_SIZE>> events;
+	Time pointerTime = 0;	// server time of the last pointer event
+
+	// the snapshot being filled, and the last one published, only after
+	// publishSnapshots()
+	std::unique_ptr<InputSnapshot> snapshot;
+	std::unique_ptr<Seqlock<InputSnapshot>> snapshots;
+
+	// this window's copy of the display's keymap, read without a lock
+	KeyTable::Table keyTable;
+	uint32_t keyTableGeneration = 0;
+
+	// the keysym each keycode that is down was pressed as, 0 if it is up
+	uint32_t heldKeys[KeyTable::KEYCODES] = {};
 	XSetWindowAttributes windowAttributes;
 	GLXContext glContext;
+	bool ownsContext = true;
 	Atom wm_delete_window;
 
 	Mouse mouse;
@@ -82,6 +142,16 @@ public:
 	bool closePending = false;
 	bool cursorHidden = false;
 	bool focusIn;
+	bool needRedraw = false;	// the size changed, resize() is due
+	bool reparented = false;	// by the window manager, see ConfigureNotify
+	bool hadEvent = false;
+	bool keepMotionHistory = false;
+	bool xinput2 = false;		// set by useXInput2()
+
+	// CLOCK_MONOTONIC nanoseconds, see getOldestEventAge()
+	int64_t drainStart = 0;
+	int64_t frameEventAge = 0;	// the longest wait of the frame so far
+	int64_t oldestEventAge = 0;	// of the last frame
 	bool debug;
 
 	int msaa;
@@ -92,91 +162,156 @@ public:
 
 	LinuxWindow (int width, int height,
 			std::string name = "name", int msaa = 8, Window parrent = 0,
-			bool debug = true)
+			bool debug = true, const LinuxWindow *share = NULL)
 	: width(width), height(height), name(name), msaa(msaa), debug(debug)
 	{
-		if ((display = XOpenDisplay(NULL)) == NULL)
-			throw std::runtime_error("Can't connect to X server");
-
-		parrentWindow = parrent ? parrent : DefaultRootWindow(display);
+		XStatsScope stats("LinuxWindow");
+
+		shared = LinuxDisplay::acquire();
+		display = shared->display;
+		connection = shared->connection;
+		window = None;
+		glContext = 0;
+
+		// if anything below throws, the window and the context made so far
+		// are destroyed and the display is released
+		struct Abandon {
+			LinuxWindow *window;
+			~Abandon() {
+				if (window)
+					window->abandon();
+			}
+		} abandonGuard{this};
 
-		// should be checked, I couldn't find the right manual for glx
-		static const int visualAttr[] =
-		{
-			GLX_X_RENDERABLE    , True,
-			GLX_DRAWABLE_TYPE   , GLX_WINDOW_BIT,
-			GLX_RENDER_TYPE     , GLX_RGBA_BIT,
-			GLX_X_VISUAL_TYPE   , GLX_TRUE_COLOR,
-			GLX_RED_SIZE        , 8,
-			GLX_GREEN_SIZE      , 8,
-			GLX_BLUE_SIZE       , 8,
-			GLX_ALPHA_SIZE      , 8,
-			GLX_DEPTH_SIZE      , 24,
-			GLX_STENCIL_SIZE    , 8,
-			GLX_DOUBLEBUFFER    , True,
-			GLX_SAMPLE_BUFFERS  , msaa > 0,			// <-- MSAA
-			GLX_SAMPLES         , msaa,				// <-- MSAA 
-			None					
-		};
+		parrentWindow = parrent ? parrent : shared->root;
 
-		 // FBConfigs were added in GLX version 1.3.
-  		int glx_major, glx_minor;
-		if (!glXQueryVersion(display, &glx_major, &glx_minor) ||
-				((glx_major == 1) && (glx_minor < 3)) || (glx_major < 1))
+		// FBConfigs were added in GLX version 1.3.
+		if (((shared->glxMajor == 1) && (shared->glxMinor < 3)) ||
+				(shared->glxMajor < 1))
 			throw std::runtime_error("Invalid GLX version");
 
-		int attribs[100];
-		memcpy(attribs, visualAttr, sizeof(visualAttr));
-
-
-		int fbcount;
-		GLXFBConfig fbconfig = 0;
-		GLXFBConfig *fbc = glXChooseFBConfig(display,
-				DefaultScreen(display), attribs, &fbcount);
-
-		/* TO DO: Find out what those are and how to use them better */
-		if (fbc) {
-			if (fbcount >= 1)
-				fbconfig = fbc[0];
-			XFree(fbc);
-		}
-
-		if (!fbconfig)
-			throw std::runtime_error("Failed to get MSAA GLXFBConfig");
-
-		if ((visualInfo = glXGetVisualFromFBConfig(display, fbconfig)) == NULL)
-			throw std::runtime_error("No visual chosen");
-		
-		colormap = XCreateColormap(display, parrentWindow,
-				visualInfo->visual, AllocNone);
+		// the config, visual and colormap belong to the display and are
+		// shared by all the windows that ask for the same thing
+		FBConfigRequest request;
+		request.samples = msaa;
+		const FBConfigChoice& choice = shared->fbConfigs.choose(request);
+		fbconfig = choice.config;
+		visualInfo = choice.visualInfo;
+		colormap = choice.colormap;
+		this->msaa = choice.samples;
+
+		// None of the window requests need a reply, they are queued on the
+		// xcb connection and go out together with the GLX ones. The window
+		// creation is checked after the XSync needed for the context anyway.
 		windowAttributes.colormap = colormap; 
 		windowAttributes.event_mask =
 				ExposureMask | KeyPressMask | KeyReleaseMask | ButtonPressMask |
-				ButtonReleaseMask | PointerMotionMask | FocusChangeMask;
+				ButtonReleaseMask | PointerMotionMask | FocusChangeMask |
+				StructureNotifyMask;
+
+		// the values must be in the order of their bits in the mask, the
+		// border pixel avoids a BadMatch if the visual isn't the parrent's
+		uint32_t windowValues[] = {
+			0,
+			(uint32_t)windowAttributes.event_mask,
+			(uint32_t)colormap
+		};
 
-		window = XCreateWindow(
-			display,
+		window = xcb_generate_id(connection);
+		xcb_void_cookie_t createCookie = xcb_create_window_checked(
+			connection,
+			visualInfo->depth,
+			window,
 			parrentWindow,
 			0,
 			0,
 			width,
 			height,
 			0,
-			visualInfo->depth,
-			InputOutput,
-			visualInfo->visual,
-			CWColormap | CWEventMask,
-			&windowAttributes
+			XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			visualInfo->visualid,
+			XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK | XCB_CW_COLORMAP,
+			windowValues
 		);
+		XStats::get().sentXcb(createCookie.sequence);
+
+		// format 32 data is read as 32 bit values, an Atom is a long
+		changeName(name);
+		xcb_atom_t protocols[] = {(xcb_atom_t)shared->wm_delete_window};
+		XStats::get().sentXcb(xcb_change_property(connection,
+				XCB_PROP_MODE_REPLACE, window, shared->wm_protocols,
+				XCB_ATOM_ATOM, 32, 1, protocols).sequence);
+		XStats::get().sentXcb(xcb_map_window(connection, window).sequence);
+
+		// Objects are shared with the given window, or with the hidden root
+		// context of the display if every window shares its objects
+		GLXContext shareContext = share ? share->glContext : 0;
+		if (!shareContext && shareRoot) {
+			if (!shared->rootContext)
+				shared->rootContext = createContext(0);
+			shareContext = shared->rootContext;
+		}
 
-		if (!window)
+		// In single context mode the windows with the display's config
+		// render with one context, made current on each of them in turn.
+		// The others get their own context sharing objects with it.
+		if (singleContext) {
+			if (!shared->singleContext) {
+				shared->singleContext = createContext(shareContext);
+				shared->singleContextConfig = fbconfig;
+			}
+			if (shared->singleContextConfig == fbconfig) {
+				glContext = shared->singleContext;
+				ownsContext = false;
+			}
+			else if (!shareContext) {
+				shareContext = shared->singleContext;
+			}
+		}
+		if (ownsContext)
+			glContext = createContext(shareContext);
+
+		// the XSync of the context creation already waited for it, so in
+		// general this doesn't block
+		xcb_generic_error_t *createError = xcb_request_check(connection,
+				createCookie);
+		if (createError) {
+			free(createError);
+			window = None;	// there is nothing to destroy
 			throw std::runtime_error("Failed to create window.\n");
+		}
 
-		changeName(name);
-		XMapWindow(display, window);
+		if (!glContext)
+			throw std::runtime_error("Failed to create an OpenGL context\n");
 
-		const char *glxExts = glXQueryExtensionsString(display,
-				DefaultScreen(display));
+		makeCurrent();
+		initGlExtensions();
+
+		// What was probed is written back for the next run. If the record
+		// came from another driver it is dropped, and what this window took
+		// from it isn't written again, the next window or run probes it.
+		GlxStartupCache& startupCache = shared->startupCache;
+		startupCache.validate((const char *)glGetString(GL_RENDERER),
+				(const char *)glGetString(GL_VERSION));
+		if (!choice.fromCache)
+			shared->fbConfigs.record(request, choice);
+		if (contextProbed)
+			startupCache.setContextVersion(contextMajor, contextMinor);
+		startupCache.save();
+		abandonGuard.window = NULL;
+
+		wm_delete_window = shared->wm_delete_window;
+		
+		registerWindowEvent();
+		initKeyboard();
+
+		active = true;
+	}
+
+	// Creates a context for this window's config that shares its objects
+	// with share, if it's not 0. Returns 0 on failure.
+	GLXContext createContext (GLXContext share) {
+		GLXContext context = 0;
 
 		using glXCreateContextAttribsARBProc = GLXContext (*)(Display*,
 				GLXFBConfig, GLXContext, Bool, const int*);
@@ -185,80 +320,118 @@ public:
 				glXGetProcAddressARB(
 				(const GLubyte *)"glXCreateContextAttribsARB");
 
-		// TO DO
 		// Install an X error handler so the application won't exit if GL 3.0
 		// context allocation fails.
 		//
 		// Note this error handler is global.  All display connections in all threads
-		// of a process use the same error handler, so be sure to guard against other
-		// threads issuing X commands while this code is running.
+		// of a process use the same error handler, so the windows create their
+		// contexts one at a time. Other threads issuing X commands that fail while
+		// this code is running would still be taken for a failed context.
+		std::lock_guard<std::mutex> ctxLock(ctxCreateMutex);
 		ctxErrorOccurred = false;
 		int (*oldHandler)(Display*, XErrorEvent*) =
 				XSetErrorHandler(&ctxErrorHandler);
 
+		// a warm start doesn't try again a version that failed the last time
+		contextProbed = !shared->startupCache.contextVersion(contextMajor,
+				contextMinor);
+
 		// Check for the GLX_ARB_create_context extension string and the function.
 		// If either is not present, use GLX 1.3 context creation method.
-		if (!isExtensionSupported(glxExts, "GLX_ARB_create_context") ||
+		if (!shared->glxExtensions.has(GlxExt::ARB_create_context) ||
 				!glXCreateContextAttribsARB)
 		{
 			printf("glXCreateContextAttribsARB() not found"
 					" ... using old-style GLX context\n");
-			glContext = glXCreateNewContext(display, fbconfig,
-					GLX_RGBA_TYPE, 0, true);
+			contextMajor = 1;
+			contextMinor = 0;
+			context = glXCreateNewContext(display, fbconfig,
+					GLX_RGBA_TYPE, share, true);
 		}
 		else {
-			int context_attribs[] =
+			std::vector<int> context_attribs =
 			{
-				GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
-				GLX_CONTEXT_MINOR_VERSION_ARB, 0,
-				debug ? GLX_CONTEXT_FLAGS_ARB : 0, debug ? GLX_CONTEXT_DEBUG_BIT_ARB : 0,
-				//GLX_CONTEXT_FLAGS_ARB        , GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB,
-				None
+				GLX_CONTEXT_MAJOR_VERSION_ARB, contextMajor,
+				GLX_CONTEXT_MINOR_VERSION_ARB, contextMinor
 			};
+			if (debug) {
+				context_attribs.push_back(GLX_CONTEXT_FLAGS_ARB);
+				context_attribs.push_back(GLX_CONTEXT_DEBUG_BIT_ARB);
+				//GLX_CONTEXT_FLAGS_ARB        , GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB,
+			}
+			// switching away from the context doesn't flush it
+			if (!flushOnSwitch && shared->glxExtensions.has(
+					GlxExt::ARB_context_flush_control))
+			{
+				context_attribs.push_back(GLX_CONTEXT_RELEASE_BEHAVIOR_ARB);
+				context_attribs.push_back(
+						GLX_CONTEXT_RELEASE_BEHAVIOR_NONE_ARB);
+			}
+			context_attribs.push_back(None);
 
-			glContext = glXCreateContextAttribsARB(display, fbconfig, 0,
-					true, context_attribs);
+			context = glXCreateContextAttribsARB(display, fbconfig, share,
+					true, context_attribs.data());
 
 			// Sync to ensure any errors generated are processed.
-			XSync(display, false);
-			if (!(!ctxErrorOccurred && glContext))
+			{
+				XStatsRoundTrip roundTrip;
+				XSync(display, false);
+			}
+			if (!(!ctxErrorOccurred && context) && contextMajor > 1)
 			{
 				// Couldn't create GL 3.0 context.  Fall back to old-style 2.x context.
 				// When a context version below 3.0 is requested, implementations will
 				// return the newest context version compatible with OpenGL versions less
 				// than version 3.0.
 				// GLX_CONTEXT_MAJOR_VERSION_ARB = 1
-				context_attribs[1] = 1;
+				context_attribs[1] = contextMajor = 1;
 				// GLX_CONTEXT_MINOR_VERSION_ARB = 0
-				context_attribs[3] = 0;
+				context_attribs[3] = contextMinor = 0;
 
 				ctxErrorOccurred = false;
 
 				printf( "Failed to create GL 3.0 context"
 						" ... using old-style GLX context\n");
-				glContext = glXCreateContextAttribsARB(display, fbconfig, 0, 
-						true, context_attribs);
+				context = glXCreateContextAttribsARB(display, fbconfig, share,
+						true, context_attribs.data());
 			}
 		}
 
 		// Sync to ensure any errors generated are processed.
-		XSync( display, False );
+		{
+			XStatsRoundTrip roundTrip;
+			XSync( display, False );
+		}
 
 		// Restore the original error handler
 		XSetErrorHandler( oldHandler );
 
-		if (ctxErrorOccurred || !glContext )
-			throw std::runtime_error("Failed to create an OpenGL context\n");
+		if (ctxErrorOccurred) {
+			if (context)
+				glXDestroyContext(display, context);
+			return 0;
+		}
+		return context;
+	}
 
-		glXMakeCurrent(display, window, glContext);
+	// the GL extensions of this window's context, needs it to be current
+	void initGlExtensions() {
+		using glGetStringiProc = const GLubyte *(*)(GLenum, GLuint);
+		glGetStringiProc getStringi = (glGetStringiProc)glXGetProcAddressARB(
+				(const GLubyte *)"glGetStringi");
+		GLint count = 0;
 
-		wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
-		Atom protocols[] = {wm_delete_window};
-		XSetWMProtocols(display, window, protocols, 1);
-		
-		initKeyboard();
+		if (getStringi && contextMajor >= 3)
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
 
-		active = true;
+		if (count > 0) {
+			glExtensions.clear();
+			for (GLint i = 0; i < count; i++)
+				glExtensions.add((const char *)getStringi(GL_EXTENSIONS, i));
+		}
+		else {
+			glExtensions.setString((const char *)glGetString(GL_EXTENSIONS));
+		}
 	}
 
 	LinuxWindow (const LinuxWindow& other) = delete;
@@ -267,30 +440,41 @@ public:
 	LinuxWindow& operator = (const LinuxWindow&& other) = delete;
 
 	void changeName (std::string name) {
+		XStatsScope stats("changeName");
 		this->name = name; 
-		XStoreName(display, window, name.c_str());
+		XStats::get().sentXcb(xcb_change_property(connection,
+				XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_NAME,
+				XCB_ATOM_STRING, 8, name.size(), name.c_str()).sequence);
 	}
 
 	void setWindowPosition() {
-		int oldX, oldY;
-		Window child;
-		XWindowAttributes xwa;
-		XTranslateCoordinates(display, window, parrentWindow,
-				0, 0, &x, &y, &child);
-		XGetWindowAttributes(display, window, &xwa);
-		
-		x = oldX - xwa.x;
-		y = oldY - xwa.y;
+		XStatsScope stats("setWindowPosition");
+		xcb_translate_coordinates_cookie_t cookie = xcb_translate_coordinates(
+				connection, window, parrentWindow, 0, 0);
+		XStats::get().sentXcb(cookie.sequence);
+		xcb_translate_coordinates_reply_t *reply;
+		{
+			XStatsRoundTrip roundTrip;
+			reply = xcb_translate_coordinates_reply(connection, cookie, NULL);
+		}
+
+		if (reply) {
+			x = reply->dst_x;
+			y = reply->dst_y;
+			free(reply);
+		}
 	}
 
+	// relative to the window itself, so its position isn't needed
 	void moveMouseTo (int dx, int dy) {
-		setWindowPosition();
+		XStatsScope stats("moveMouseTo");
 		XSelectInput(display, parrentWindow, KeyReleaseMask); 
-		XWarpPointer(display, None, parrentWindow, 0, 0, 0, 0, x + dx, y + dy);
+		XWarpPointer(display, None, window, 0, 0, 0, 0, dx, dy);
 		XFlush(display);
 	}
 
 	void hideCursor() {
+		XStatsScope stats("hideCursor");
 		if (!cursorHidden) {
 			XColor dummy;
 			const char data = 0;
@@ -309,6 +493,7 @@ public:
 	}
 
 	void showCursor() {
+		XStatsScope stats("showCursor");
 		if (cursorHidden) {
 			cursorHidden = false; 
 			XUndefineCursor(display, window);
@@ -318,46 +503,299 @@ public:
 	void close() {
 		if (!active)
 			return;
-		glXMakeCurrent(display, None, NULL);
-		glXDestroyContext(display, glContext);
-		XDestroyWindow(display, window);
-		XCloseDisplay(display);
+		XStatsScope stats("close");
+		unregisterWindowEvent();
+		if (statsFrameWindow() == this)
+			statsFrameWindow() = NULL;
+		abandon();
 
 		active = false; 
 	}
 
+	// Destroys what the window has made of its context and X window and
+	// releases the display, also for a constructor that threw halfway.
+	// Other windows might be using the context, so it is released only if
+	// this window's drawable is the current one.
+	void abandon() {
+		GlxCurrent& current = GlxCurrent::get();
+		if (window && current.display == display &&
+				current.drawable == window) {
+			glXMakeCurrent(display, None, NULL);
+			current.forget();
+		}
+		if (ownsContext && glContext)
+			glXDestroyContext(display, glContext);
+		if (window) {
+			XStats::get().sentXcb(xcb_destroy_window(connection,
+					window).sequence);
+			xcb_flush(connection);
+		}
+		LinuxDisplay::release();
+		display = NULL;
+	}
+
 	void updateKeyboard (const XEvent& event) {
-		KeySym code = XkbKeycodeToKeysym(display, event.xkey.keycode, 0,
-				event.xkey.state & ShiftMask ? 1 : 0);
-		keyboard.registerEvent(code, event.type == KeyPress);
+		// the copy of the keymap is refreshed only after a mapping change
+		if (keyTableGeneration != shared->keyTable.generation())
+			shared->keyTable.copy(keyTable, keyTableGeneration);
+
+		// A press of a key that is down is a repeat. The release reports
+		// the keysym of the press, even if the modifiers changed since.
+		unsigned int keycode = event.xkey.keycode & (KeyTable::KEYCODES - 1);
+		bool press = event.type == KeyPress;
+		bool repeat = press && heldKeys[keycode];
+		KeySym code = heldKeys[keycode];
+		if (!code)
+			code = keyTable.lookup(keycode, event.xkey.state);
+		heldKeys[keycode] = press ? code : 0;
+
+		int64_t time = eventTime(event.xkey.time);
+		keyboard.registerEvent(code, press, event.xkey.time, time, repeat);
+
+		if (recording()) {
+			InputEvent key = InputEvent::make(InputEvent::KEY, event.xkey.time,
+					time);
+			key.key = {(int)code, press, repeat};
+			record(key);
+		}
+	}
+
+	// The releases of the keys that are down go to the window with the
+	// focus, so they are released when it leaves. Otherwise their next press
+	// would be taken for a repeat.
+	void releaseHeldKeys() {
+		for (unsigned int keycode = 0; keycode < KeyTable::KEYCODES;
+				keycode++)
+		{
+			KeySym code = heldKeys[keycode];
+			if (!code)
+				continue;
+			heldKeys[keycode] = 0;
+			keyboard.registerEvent(code, false);
+
+			if (recording()) {
+				InputEvent key = InputEvent::make(InputEvent::KEY);
+				key.key = {(int)code, false, false};
+				record(key);
+			}
+		}
 	}
 
 	void updateMouse (const XEvent& event) {
-		if (event.type == ButtonPress) {
-			if (event.xbutton.button == Button1)
-				mouse.updateLmb(true);
-			if (event.xbutton.button == Button2)
-				mouse.updateMmb(true);
-			if (event.xbutton.button == Button3)
-				mouse.updateRmb(true);
+		if (event.type == MotionNotify) {
+			pointerTime = event.xmotion.time;
+			mouse.time = eventTime(event.xmotion.time);
+			queueMotion(event.xmotion.x, event.xmotion.y, event.xmotion.time,
+					mouse.time);
+			return;
 		}
-		else if (event.type == ButtonRelease) {
-			if (event.xbutton.button == Button1)
-				mouse.updateLmb(false);
-			if (event.xbutton.button == Button2)
-				mouse.updateMmb(false);
-			if (event.xbutton.button == Button3)
-				mouse.updateRmb(false);
+		pointerTime = event.xbutton.time;
+		mouse.time = eventTime(event.xbutton.time);
+
+		// a click happens where the pointer is at that moment
+		flushMotion();
+		updateButton(event.xbutton.button, event.type == ButtonPress);
+	}
+
+	// the buttons 4 to 7 are the wheel, each press is a notch
+	void updateButton (unsigned int button, bool press) {
+		if (button == Button1)
+			mouse.updateLmb(press);
+		else if (button == Button2)
+			mouse.updateMmb(press);
+		else if (button == Button3)
+			mouse.updateRmb(press);
+		else if (press && button == Button4)
+			updateWheel(0, 1);
+		else if (press && button == Button5)
+			updateWheel(0, -1);
+		else if (press && button == 6)
+			updateWheel(-1, 0);
+		else if (press && button == 7)
+			updateWheel(1, 0);
+
+		if (recording() && button >= Button1 && button <= Button3) {
+			InputEvent event = InputEvent::make(InputEvent::BUTTON,
+					pointerTime, mouse.time);
+			event.button = {(int)button - Button1, press};
+			record(event);
 		}
-		else if (event.type == MotionNotify) {
-			mouse.updateXY(event.xmotion.x, event.xmotion.y);
+	}
+
+	void updateWheel (float x, float y) {
+		if (y)
+			mouse.updateWheel(y);
+		if (x)
+			mouse.updateWheelX(x);
+
+		if (recording()) {
+			InputEvent event = InputEvent::make(InputEvent::WHEEL, pointerTime,
+					mouse.time);
+			event.wheel = {x, y};
+			record(event);
+		}
+	}
+
+	// Starts queueing every input event of the window, for the consumer of
+	// drainEvents(). Call it before that thread starts.
+	void recordEvents() {
+		if (!events)
+			events.reset(new SpscRing<InputEvent, EVENT_RING_SIZE>());
+	}
+
+	// the recorded events, oldest first, as many as fit in out
+	size_t drainEvents (Span<InputEvent> out) {
+		return events ? events->drain(out) : 0;
+	}
+
+	// Publishes an InputSnapshot at the end of every handleInput(). Call it
+	// before the threads that read them start.
+	void publishSnapshots() {
+		if (snapshots)
+			return;
+		snapshot.reset(new InputSnapshot());
+		snapshots.reset(new Seqlock<InputSnapshot>());
+	}
+
+	// From any thread, copies the last snapshot to out without a lock.
+	// Returns its version, 0 if none was published yet.
+	uint64_t readSnapshot (InputSnapshot& out) const {
+		return snapshots ? snapshots->load(out) : 0;
+	}
+
+	bool recording() const {
+		return events || snapshot;
+	}
+
+	void record (const InputEvent& event) {
+		if (events)
+			events->push(event);
+		if (snapshot)
+			snapshot->addEvent(event);
+	}
+
+	/*
+		Moves the pointer input of this window to XInput2: positions with
+		their fraction, smooth scrolling, and the unaccelerated motion in
+		mouse.rawDx/rawDy while the window has the keyboard focus. Returns
+		false if the server doesn't have XInput 2.1, the core events are
+		used then.
+	*/
+	bool useXInput2() {
+		if (!active)
+			return false;
+		XStatsScope stats("useXInput2");
+		if (xinput2)
+			return true;
+
+		XInputPointer& xinput = shared->xinput;
+		xinput.init(display);
+		if (!xinput.available)
+			return false;
+		xinput.selectWindow(window);
+		xinput.selectRoot(shared->root);
+		XFlush(display);
+		xinput2 = true;
+		return true;
+	}
+
+	void updateXInput2 (const XIPointerEvent& pointer) {
+		if (!xinput2)
+			return;
+		pointerTime = pointer.time;
+		mouse.time = eventTime(pointer.time);
+		if (pointer.evtype == XI_RawMotion) {
+			mouse.updateRaw(pointer.dx, pointer.dy);
+		}
+		else if (pointer.evtype == XI_Motion) {
+			queueMotion(pointer.x, pointer.y, pointer.time, mouse.time);
+			if (pointer.scrollX || pointer.scrollY)
+				updateWheel(pointer.scrollX, pointer.scrollY);
+		}
+		else {
+			flushMotion();
+			updateButton(pointer.button, pointer.evtype == XI_ButtonPress);
+		}
+	}
+
+	// Returns the positions the mouse went through during the last
+	// handleInput(), oldest first, if keepMotionHistory is set. Valid until
+	// the next handleInput(). Past MAX_MOTION_HISTORY the older samples are
+	// thinned out, getMotionDropped() counts them.
+	Span<const MotionSample> getMotionHistory() const {
+		return Span<const MotionSample>(motionHistory.data(),
+				motionHistory.size());
+	}
+
+	uint32_t getMotionDropped() const {
+		return motionDropped;
+	}
+
+	void queueMotion (float x, float y, Time serverTime, int64_t time) {
+		motionPending = true;
+		motionX = x;
+		motionY = y;
+		if (!keepMotionHistory)
+			return;
+
+		// a full history keeps every other sample, the path still goes from
+		// the first position of the frame to the last
+		if (frameMotion.size() == MAX_MOTION_HISTORY) {
+			size_t kept = MAX_MOTION_HISTORY / 2;
+			for (size_t i = 0; i < kept; i++)
+				frameMotion[i] = frameMotion[2 * i + 1];
+			frameMotion.resize(kept);
+			frameMotionDropped += kept;
+		}
+		frameMotion.push_back({x, y, (uint32_t)serverTime, time});
+	}
+
+	void flushMotion() {
+		if (!motionPending)
+			return;
+		motionPending = false;
+		mouse.updateXY(motionX, motionY);
+
+		if (recording()) {
+			InputEvent event = InputEvent::make(InputEvent::MOTION, pointerTime,
+					mouse.time);
+			event.motion = {mouse.x, mouse.y, mouse.x - mouse.lastX,
+					mouse.y - mouse.lastY};
+			record(event);
 		}
 	}
 
 	void focus() {
 		if (!active)
 			return;
-		glXMakeCurrent(display, window, glContext);
+		XStatsScope stats("focus");
+
+		// the viewport belongs to the context, not to the window
+		if (makeCurrent() && !ownsContext)
+			glViewport(0, 0, width, height);
+	}
+
+	// true if this window's context is current on this thread, on it
+	bool isFocused() const {
+		return GlxCurrent::get().isCurrent(display, window, glContext);
+	}
+
+	// Returns false if the window was already current on this thread. Throws
+	// if it can't be made current, what is current then isn't known.
+	bool makeCurrent() {
+		GlxCurrent& current = GlxCurrent::get();
+
+		if (current.isCurrent(display, window, glContext)) {
+			current.elided++;
+			return false;
+		}
+		if (!glXMakeCurrent(display, window, glContext)) {
+			current.forget();
+			throw std::runtime_error("Can't focus rendering context!");
+		}
+		current.set(display, window, glContext);
+		current.switches++;
+		return true;
 	}
 
 	template <typename FuncType>
@@ -374,12 +812,88 @@ public:
 	void setVSync (bool sync) {
 		if (!active)
 			return;
-		// TO DO; nothing, really 
+		setSwapInterval(sync ? 1 : 0);
+	}
+
+	// EXT_swap_control sets it on the drawable, the MESA and SGI versions on
+	// the current context, so they make this window current first
+	bool setSwapInterval (int interval) {
+		GlxExtensionSet& exts = shared->glxExtensions;
+
+		if (exts.has(GlxExt::EXT_swap_control)) {
+			using Proc = void (*)(Display *, GLXDrawable, int);
+			Proc proc = (Proc)glXGetProcAddressARB(
+					(const GLubyte *)"glXSwapIntervalEXT");
+			if (proc) {
+				proc(display, window, interval);
+				swapInterval = interval;
+				return true;
+			}
+		}
+
+		makeCurrent();
+		if (exts.has(GlxExt::MESA_swap_control)) {
+			using Proc = int (*)(unsigned int);
+			Proc proc = (Proc)glXGetProcAddressARB(
+					(const GLubyte *)"glXSwapIntervalMESA");
+			if (proc && proc(interval) == 0) {
+				swapInterval = interval;
+				return true;
+			}
+		}
+		// SGI can't turn vsync off
+		if (exts.has(GlxExt::SGI_swap_control) && interval > 0) {
+			using Proc = int (*)(int);
+			Proc proc = (Proc)glXGetProcAddressARB(
+					(const GLubyte *)"glXSwapIntervalSGI");
+			if (proc && proc(interval) == 0) {
+				swapInterval = interval;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// true if setting the swap interval of one window sets the other's,
+	// the MESA and SGI intervals belong to the context
+	bool sharesSwapInterval (const LinuxWindow *other) const {
+		if (!active || !other->active)
+			return false;
+		return other != this && glContext == other->glContext &&
+				!shared->glxExtensions.has(GlxExt::EXT_swap_control);
+	}
+
+	// Puts the window in the hardware swap group of leader, its buffers are
+	// then swapped together with the group's. NULL leaves the group. Returns
+	// false if the driver has no swap groups.
+	bool joinSwapGroup (const LinuxWindow *leader) {
+		if (!active)
+			return false;
+		GlxExtensionSet& exts = shared->glxExtensions;
+
+		if (exts.has(GlxExt::NV_swap_group)) {
+			using Proc = Bool (*)(Display *, GLXDrawable, GLuint);
+			Proc proc = (Proc)glXGetProcAddressARB(
+					(const GLubyte *)"glXJoinSwapGroupNV");
+			return proc && proc(display, window, leader ? 1 : 0);
+		}
+		if (exts.has(GlxExt::SGIX_swap_group)) {
+			using Proc = void (*)(Display *, GLXDrawable, GLXDrawable);
+			Proc proc = (Proc)glXGetProcAddressARB(
+					(const GLubyte *)"glXJoinSwapGroupSGIX");
+			if (!proc)
+				return false;
+			if (leader != this)
+				proc(display, window, leader ? leader->window : None);
+			return true;
+		}
+		return false;
 	}
 
 	void swapBuffers() {
 		if (!active)
 			return;
+		XStatsScope stats("swapBuffers");
 		glXSwapBuffers(display, window);
 	}
 
@@ -387,104 +901,474 @@ public:
 		closePending = true;
 	}
 
-	bool handleInput() {
-		bool needRedraw = false;
+	static std::unordered_map<Window, LinuxWindow *> eventMap;
+
+	// if set, the windows created after share their objects with each other
+	// through a hidden context, without having to name a window to share with
+	static bool shareRoot;
+
+	// if set, the windows created after render with a single context that
+	// focus() makes current on each window's drawable, if they have the same
+	// config, instead of switching between a context for every window
+	static bool singleContext;
+
+	// If cleared, the contexts created after don't flush when focus() moves
+	// to another window (GLX_ARB_context_flush_control). Each window must then
+	// be swapped while it is the focused one, as in the usual draw loop.
+	static bool flushOnSwitch;
+
+	// Drains the shared connection once and routes every event to the window
+	// it belongs to, then ends the frame of every window without a render
+	// thread
+	static bool handleAllInput() {
+		LinuxDisplay *shared = LinuxDisplay::get();
+
+		// every call to the dispatcher is counted as a new frame
+		XStats::get().endFrame();
+		XStatsScope stats("handleAllInput");
+
+		if (!shared)
+			return false;
+
+		bool hadEvent = dispatch(shared);
+
+		// close() unregisters the window, so the map can't be walked directly,
+		// the windows with a render thread finish their input there
+		std::vector<LinuxWindow *> windows;
+		{
+			std::lock_guard<std::mutex> lock(eventMapMutex());
+			windows.reserve(eventMap.size());
+			for (auto&& pair : eventMap)
+				if (!pair.second->inputRing)
+					windows.push_back(pair.second);
+		}
+		for (auto&& window : windows)
+			window->finishInput();
+
+		return hadEvent;
+	}
+
+	// Routes the events of the connection to their windows. The windows sum
+	// them into their current frame, which only their finishInput() ends, so
+	// the others keep what they received until their own handleInput().
+	static bool dispatch (LinuxDisplay *shared) {
 		bool hadEvent = false;
-		XWindowAttributes eventWindowAttributes;
 		XEvent event;
 
+		// render threads may close their windows while this runs
+		std::unique_lock<std::mutex> lock(eventMapMutex());
+		int64_t drainStart = InputClock::now();
+		for (auto&& pair : eventMap)
+			if (!pair.second->inputRing)
+				pair.second->drainStart = drainStart;
+		while (XPending(shared->display)) {
+			XNextEvent(shared->display, &event);
+
+			if (event.type == GenericEvent && !decodeXInput2(shared, event))
+				continue;
+			if (shared->keyTable.handleEvent(event))
+				continue;
+			if (event.type == KeyRelease && isRepeatRelease(shared, event))
+				continue;
+			trackFocus(shared, event);
+
+			Time time;
+			if (serverTime(event, time))
+				shared->clock.observe(time, InputClock::now());
+
+			auto it = eventMap.find(event.xany.window);
+			if (it != eventMap.end()) {
+				it->second->eventProc(event);
+				hadEvent = true;
+			}
+		}
+		lock.unlock();
+
+		// last, a task may close the last window and with it the display
+		if (shared->tasks.runAll())
+			hadEvent = true;
+		return hadEvent;
+	}
+
+	// Replaces an XInput2 event with its decoded values, addressed to the
+	// window it belongs to. Returns false if no window wants it.
+	static bool decodeXInput2 (LinuxDisplay *shared, XEvent& event) {
+		XGenericEventCookie& cookie = event.xcookie;
+		if (cookie.extension != shared->xinput.opcode ||
+				!XGetEventData(shared->display, &cookie))
+			return false;
+
+		XIPointerEvent pointer;
+		bool wanted = shared->xinput.decode(cookie, pointer);
+		XFreeEventData(shared->display, &cookie);
+		if (!wanted)
+			return false;
+
+		// the raw motion is reported on the root window
+		if (pointer.evtype == XI_RawMotion)
+			pointer.window = shared->focusWindow;
+		pointer.toXEvent(event);
+		return true;
+	}
+
+	// Without detectable autorepeat, a repeat is a KeyRelease followed by a
+	// KeyPress of the same key with the same time, already in the queue
+	static bool isRepeatRelease (LinuxDisplay *shared, const XEvent& event) {
+		if (shared->detectableRepeat ||
+				!XEventsQueued(shared->display, QueuedAlready))
+			return false;
+
+		XEvent next;
+		XPeekEvent(shared->display, &next);
+		return next.type == KeyPress &&
+				next.xkey.window == event.xkey.window &&
+				next.xkey.keycode == event.xkey.keycode &&
+				next.xkey.time - event.xkey.time <= 1;
+	}
+
+	static void trackFocus (LinuxDisplay *shared, const XEvent& event) {
+		if (event.type == FocusIn)
+			shared->focusWindow = event.xfocus.window;
+		else if (event.type == FocusOut &&
+				shared->focusWindow == event.xfocus.window)
+			shared->focusWindow = None;
+	}
+
+	// Blocks until there is input for any window or timeoutMs passes
+	// (-1 waits forever), then dispatches it like handleAllInput()
+	static bool waitEvents (int timeoutMs = -1) {
+		LinuxDisplay *shared = LinuxDisplay::get();
+
+		if (!shared)
+			return false;
+
+		// flushes our requests, the replies might be the events we wait for
+		if (!XEventsQueued(shared->display, QueuedAfterFlush)) {
+			pollfd pfd[2];
+			pfd[0].fd = ConnectionNumber(shared->display);
+			pfd[0].events = POLLIN;
+			pfd[0].revents = 0;
+			pfd[1].fd = shared->wakeFd;
+			pfd[1].events = POLLIN;
+			pfd[1].revents = 0;
+
+			int ret;
+			do {
+				ret = poll(pfd, 2, timeoutMs);
+			} while (ret < 0 && errno == EINTR && timeoutMs < 0);
+
+			if (ret > 0 && (pfd[1].revents & POLLIN))
+				shared->clearWake();
+		}
+
+		return handleAllInput();
+	}
+
+	// Interrupts waitEvents() from any thread, without going through the
+	// X server. Does nothing once all the windows are closed.
+	static void wake() {
+		LinuxDisplay::wakeShared();
+	}
+
+	// Runs func on the thread that handles the input, on the next dispatch.
+	// Once all the windows are closed func is dropped.
+	static void post (std::function<void()> func) {
+		LinuxDisplay::postShared(std::move(func));
+	}
+
+	// Returns true if this window received events since the last call, and
+	// ends its frame, the other windows keep summing theirs. With a render
+	// thread, it takes the events routed by the input thread.
+	bool handleInput() {
 		if (!active)
 			return false;
-		while (active && XPending(display)) {
-			XNextEvent(display, &event);
 
-			hadEvent = true;
-			if (event.type == Expose) {
-				XGetWindowAttributes (display, window, &eventWindowAttributes);
-				needRedraw = true; 
-			}
-			else if (Util::isEqualToAny(event.type, {KeyPress, KeyRelease})) {
-				updateKeyboard(event);
-			}
-			else if (Util::isEqualToAny(event.type,
-					{MotionNotify, ButtonPress, ButtonRelease}))
-			{
-				updateMouse(event);
+		if (inputRing) {
+			XEvent event;
+			drainStart = InputClock::now();
+			while (inputRing->pop(event))
+				applyEvent(event);
+		}
+		else {
+			// the statistics count a frame each time the window handled
+			// first comes around again
+			LinuxWindow *&statsWindow = statsFrameWindow();
+			if (!statsWindow || statsWindow == this) {
+				XStats::get().endFrame();
+				statsWindow = this;
 			}
-			else if (Util::isEqualToAny(event.type, {FocusIn, FocusOut})) {
-				if (event.type == FocusIn)
-					focusIn = true;
-				if (event.type == FocusOut)
-					focusIn = false;
+			XStatsScope stats("handleInput");
+			dispatch(shared);
+		}
+		// a posted task may have closed the window
+		if (active)
+			finishInput();
+
+		bool ret = hadEvent;
+		hadEvent = false;
+		return ret;
+	}
+
+	/*
+		Threading model: one input thread owns the connection and calls
+		handleAllInput() or waitEvents(), each window with a render thread
+		receives its events through a lock free ring and applies them when
+		that thread calls handleInput(). The keyboard, the mouse and the
+		context of the window are then only touched by the render thread.
+
+		Call useRenderThread() on the thread that created the window, before
+		the render thread starts, it releases the context so the render
+		thread can focus() it. The input thread should hold its own
+		LinuxDisplay::acquire() so the connection outlives the windows.
+
+		A context is current on one thread at a time, so the windows of
+		singleContext, which share theirs, can't have render threads.
+	*/
+	void useRenderThread() {
+		if (inputRing)
+			return;
+		if (!ownsContext)
+			throw std::runtime_error("A window without a context of its own "
+					"can't have a render thread");
+		{
+			std::lock_guard<std::mutex> lock(eventMapMutex());
+			inputRing.reset(new SpscRing<XEvent, INPUT_RING_SIZE>());
+		}
+		releaseContext();
+	}
+
+	// makes no context current on the calling thread if this window's is
+	void releaseContext() {
+		GlxCurrent& current = GlxCurrent::get();
+		if (current.display == display && current.context == glContext) {
+			glXMakeCurrent(display, None, NULL);
+			current.forget();
+		}
+	}
+
+	// called by the dispatcher, on the input thread
+	void eventProc (const XEvent& event) {
+		// a full ring drops the event, inputRing->overflows() counts them
+		if (inputRing) {
+			inputRing->push(event);
+			return;
+		}
+		applyEvent(event);
+	}
+
+	void applyEvent (const XEvent& event) {
+		hadEvent = true;
+		if (event.type == ConfigureNotify) {
+			updateGeometry(event.xconfigure);
+		}
+		else if (event.type == ReparentNotify) {
+			reparented = event.xreparent.parent != parrentWindow;
+		}
+		else if (Util::isEqualToAny(event.type, {KeyPress, KeyRelease})) {
+			updateKeyboard(event);
+		}
+		else if (Util::isEqualToAny(event.type,
+				{MotionNotify, ButtonPress, ButtonRelease}))
+		{
+			updateMouse(event);
+		}
+		else if (event.type == XIPointerEvent::TYPE) {
+			updateXInput2(XIPointerEvent::fromXEvent(event));
+		}
+		else if (Util::isEqualToAny(event.type, {FocusIn, FocusOut})) {
+			if (event.type == FocusIn)
+				focusIn = true;
+			if (event.type == FocusOut) {
+				focusIn = false;
+				releaseHeldKeys();
 			}
-			else if (ClientMessage && event.xclient.data.l[0] == wm_delete_window) {
-				closePending = true;
+
+			if (recording()) {
+				InputEvent focus = InputEvent::make(InputEvent::FOCUS);
+				focus.focus = {focusIn};
+				record(focus);
 			}
 		}
+		else if (event.type == ClientMessage &&
+				(Atom)event.xclient.data.l[0] == wm_delete_window)
+		{
+			closePending = true;
+		}
+	}
+
+	// The size is always right. The position of a window the window manager
+	// reparented is relative to its frame in the real events, only the
+	// synthetic ones the manager sends on a move are relative to the root.
+	void updateGeometry (const XConfigureEvent& event) {
+		if (event.width != width || event.height != height) {
+			width = event.width;
+			height = event.height;
+			needRedraw = true;
+		}
+		if (event.send_event || !reparented) {
+			x = event.x;
+			y = event.y;
+		}
+	}
+
+	// what finishInput() published stays readable, the next frame starts
+	// summing from nothing
+	void beginFrame() {
+		frameMotion.clear();
+		frameMotionDropped = 0;
+		mouse.beginFrame();
+		keyboard.beginFrame();
+		frameEventAge = 0;
+
+		if (snapshot) {
+			snapshot->eventCount = 0;
+			snapshot->droppedEvents = 0;
+		}
+	}
+
+	// CLOCK_MONOTONIC nanoseconds of an event, remembers the longest an
+	// event of the frame waited for the drain that handled it
+	int64_t eventTime (Time serverTime) {
+		int64_t time = shared->clock.toMonotonic(serverTime);
+		if (time && drainStart - time > frameEventAge)
+			frameEventAge = drainStart - time;
+		return time;
+	}
+
+	// the time the server stamped on the events that have one
+	static bool serverTime (const XEvent& event, Time& time) {
+		switch (event.type) {
+			case KeyPress:
+			case KeyRelease: time = event.xkey.time; return true;
+			case ButtonPress:
+			case ButtonRelease: time = event.xbutton.time; return true;
+			case MotionNotify: time = event.xmotion.time; return true;
+			case EnterNotify:
+			case LeaveNotify: time = event.xcrossing.time; return true;
+			case PropertyNotify: time = event.xproperty.time; return true;
+		}
+		if (event.type == XIPointerEvent::TYPE) {
+			time = XIPointerEvent::fromXEvent(event).time;
+			return true;
+		}
+		return false;
+	}
 
-		if (active) {
-			if (needRedraw) {
-				width = eventWindowAttributes.width; 
-				height = eventWindowAttributes.height;
-				setWindowPosition();
-				resize();
+	// How long the oldest event of the last handleInput() waited before it
+	// was processed, in nanoseconds. 0 if none of them had a time.
+	int64_t getOldestEventAge() const {
+		return oldestEventAge;
+	}
+
+	void finishInput() {
+		XStatsScope stats("finishInput");
+		flushMotion();
+		mouse.endFrame();
+		keyboard.endFrame();
+		motionHistory.swap(frameMotion);
+		motionDropped = frameMotionDropped;
+		oldestEventAge = frameEventAge;
+
+		// once for the whole batch of ConfigureNotify events
+		if (active && needRedraw) {
+			resize();
+
+			if (recording()) {
+				InputEvent event = InputEvent::make(InputEvent::RESIZE);
+				event.resize = {width, height};
+				record(event);
 			}
 		}
+		needRedraw = false;
+
+		if (snapshot) {
+			snapshot->frame++;
+			snapshot->time = drainStart;
+			snapshot->width = width;
+			snapshot->height = height;
+			snapshot->focus = focusIn;
+			snapshot->keys = keyboard.getKeyBits();
+			snapshot->pressed = keyboard.getPressedBits();
+			snapshot->released = keyboard.getReleasedBits();
+			snapshot->mouse = mouse.getFrame();
+			snapshots->store(*snapshot);
+		}
+		beginFrame();
 
 		if (closePending) {
 			close();
 		}
+	}
 
-		return hadEvent;
+	// the window whose handleInput() ends the frames of XStats
+	static LinuxWindow *&statsFrameWindow() {
+		static LinuxWindow *window = NULL;
+		return window;
+	}
+
+	static std::mutex& eventMapMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	void registerWindowEvent() {
+		std::lock_guard<std::mutex> lock(eventMapMutex());
+		eventMap[window] = this;
+	}
+
+	void unregisterWindowEvent() {
+		std::lock_guard<std::mutex> lock(eventMapMutex());
+		eventMap.erase(window);
 	}
 
+	// in the order of KeyNames::names
+	static constexpr KeyMap keyMap = makeKeyMap({
+		XK_Return,				// ENTER
+		XK_space,				// SPACE
+		XK_Caps_Lock,			// CAPS_LOCK
+		XK_Tab,					// TAB
+		XK_Alt_L,				// L_ALT
+		XK_Alt_R,				// R_ALT
+		XK_Control_L,			// L_CTRL
+		XK_Control_R,			// R_CTRL
+		XK_Shift_L,				// L_SHIFT
+		XK_Shift_R,				// R_SHIFT
+		XK_Up,					// ARROW_UP
+		XK_Down,				// ARROW_DOWN
+		XK_Left,				// ARROW_LEFT
+		XK_Right,				// ARROW_RIGHT
+		XK_F1,					// F1
+		XK_F2,					// F2
+		XK_F3,					// F3
+		XK_F4,					// F4
+		XK_F5,					// F5
+		XK_F6,					// F6
+		XK_F7,					// F7
+		XK_F8,					// F8
+		XK_F9,					// F9
+		XK_F10,					// F10
+		XK_F11,					// F11
+		XK_F12,					// F12
+		XK_BackSpace,			// BACKSPACE
+		XK_Insert,				// INSERT
+		XK_Delete,				// DELETE
+		XK_Home,				// HOME
+		XK_Page_Up,				// PAGE_UP
+		XK_Page_Down,			// PAGE_DOWN
+		XK_End,					// END
+		XK_Print,				// PRINT_SCREEN
+		XK_Scroll_Lock,			// SCREEN_LOCK
+		XK_Pause,				// PAUSE
+		XK_Num_Lock,			// NUM_LOCK
+		XK_KP_Enter,			// NUM_ENTER
+		XK_KP_Insert,			// NUM_INSERT
+		XK_Super_L,				// WINKEY
+		0,						// FN
+		XK_Escape				// ESC
+	});
+
 	void initKeyboard() {
-		std::map<std::string, int> mapping;
-
-		mapping["ENTER"] = XK_Return;
-		mapping["SPACE"] = XK_space;
-		mapping["CAPS_LOCK"] = XK_Caps_Lock;
-		mapping["TAB"] = XK_Tab;
-		mapping["L_ALT"] = XK_Alt_L;
-		mapping["R_ALT"] = XK_Alt_R;
-		mapping["L_CTRL"] = XK_Control_L;
-		mapping["R_CTRL"] = XK_Control_R;
-		mapping["L_SHIFT"] = XK_Shift_L;
-		mapping["R_SHIFT"] = XK_Shift_R;
-		mapping["ARROW_UP"] = XK_Up;
-		mapping["ARROW_DOWN"] = XK_Down;
-		mapping["ARROW_LEFT"] = XK_Left;
-		mapping["ARROW_RIGHT"] = XK_Right;
-		mapping["F1"] = XK_F1;
-		mapping["F2"] = XK_F2;
-		mapping["F3"] = XK_F3;
-		mapping["F4"] = XK_F4;
-		mapping["F5"] = XK_F5;
-		mapping["F6"] = XK_F6;
-		mapping["F7"] = XK_F7;
-		mapping["F8"] = XK_F8;
-		mapping["F9"] = XK_F9;
-		mapping["F10"] = XK_F10;
-		mapping["F11"] = XK_F11;
-		mapping["F12"] = XK_F12;
-		mapping["BACKSPACE"] = XK_BackSpace;
-		mapping["INSERT"] = XK_Insert;
-		mapping["DELETE"] = XK_Delete;
-		mapping["HOME"] = XK_Home;
-		mapping["PAGE_UP"] = XK_Page_Up;
-		mapping["PAGE_DOWN"] = XK_Page_Down;
-		mapping["END"] = XK_End;
-		mapping["PRINT_SCREEN"] = XK_Print;
-		mapping["SCREEN_LOCK"] = XK_Scroll_Lock;
-		mapping["PAUSE"] = XK_Pause;
-		mapping["NUM_LOCK"] = XK_Num_Lock;
-		mapping["NUM_ENTER"] = XK_KP_Enter;
-		mapping["NUM_INSERT"] = XK_KP_Insert;
-		mapping["WINKEY"] = XK_Super_L;
-		mapping["FN"] = 0;
-		mapping["ESC"] = XK_Escape;
-
-		keyboard.mapKeys(mapping);
+		keyboard.mapKeys(keyMap);
 	}
 
 	std::string toString() {
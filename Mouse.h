@@ -1,6 +1,41 @@
 #ifndef MOUSE_H
 #define MOUSE_H
 
+#include <cstdint>
+
+// one pointer position as the window system reported it
+struct MotionSample {
+	float x;
+	float y;
+	uint32_t serverTime;	// the window system's time, in milliseconds
+	int64_t time;			// CLOCK_MONOTONIC nanoseconds, 0 if unknown
+};
+
+// what the mouse did during one frame, see Mouse::beginFrame()
+struct MouseFrame {
+	float x = 0;
+	float y = 0;
+	float dx = 0;
+	float dy = 0;
+	float rawDx = 0;	// before the pointer acceleration, if the window
+	float rawDy = 0;	// system reports it
+	float wheel = 0;	// in notches, positive away from the user
+	float wheelX = 0;	// positive to the right
+
+	bool lmb = false;
+	bool mmb = false;
+	bool rmb = false;
+
+	int64_t time = 0;	// of the last event, CLOCK_MONOTONIC nanoseconds
+};
+
+/*
+	The movement between beginFrame() and endFrame() is summed in dx, dy and
+	wheel, however many events it came in. endFrame() copies the totals and
+	the buttons to the frame returned by getFrame(), which the render code
+	reads while the next frame's events are summed. The windows call both
+	around each handleInput().
+*/
 class Mouse {
 public:
 	float x = 0;
@@ -20,11 +55,55 @@ public:
 	
 	bool rmb = false;
 	bool onceRmb = false;
+
+	float dx = 0;
+	float dy = 0;
+	float rawDx = 0;
+	float rawDy = 0;
+	float wheel = 0;
+	float wheelX = 0;
+
+	int64_t time = 0;	// of the last event, set by the window
+
+	void beginFrame() {
+		dx = 0;
+		dy = 0;
+		rawDx = 0;
+		rawDy = 0;
+		wheel = 0;
+		wheelX = 0;
+	}
+
+	void endFrame() {
+		frame.x = x;
+		frame.y = y;
+		frame.dx = dx;
+		frame.dy = dy;
+		frame.rawDx = rawDx;
+		frame.rawDy = rawDy;
+		frame.wheel = wheel;
+		frame.wheelX = wheelX;
+		frame.lmb = lmb;
+		frame.mmb = mmb;
+		frame.rmb = rmb;
+		frame.time = time;
+	}
+
+	const MouseFrame& getFrame() const {
+		return frame;
+	}
 	
 	void updateXY (float x, float y) {
 		lastX = this->x;
 		lastY = this->y;
 
+		// the first position isn't a movement
+		if (hasPosition) {
+			dx += x - this->x;
+			dy += y - this->y;
+		}
+		hasPosition = true;
+
 		this->x = x;
 		this->y = y;
 	}
@@ -39,6 +118,20 @@ public:
 		mmbPos = pos;
 	}
 
+	void updateWheel (float notches) {
+		wheel += notches;
+		updateMmbPos(mmbPos + notches);
+	}
+
+	void updateWheelX (float notches) {
+		wheelX += notches;
+	}
+
+	void updateRaw (float dx, float dy) {
+		rawDx += dx;
+		rawDy += dy;
+	}
+
 	void updateLmb (bool btn) {
 		if (!btn)
 			onceLmb = false;
@@ -104,6 +197,10 @@ public:
 			return false;
 		}
 	}
+
+private:
+	MouseFrame frame;
+	bool hasPosition = false;
 };
 
 #endif
\ No newline at end of file
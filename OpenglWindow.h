@@ -6,15 +6,46 @@
 			- options are per window
 		vSync -> t/f, sets if vSync is enabled
 
+	Sharing:
+		share				// window whose textures, buffers and shaders
+							// are also visible in the new window
+		shareRoot			// linux only, static, all windows created after
+							// it is set share their objects
+		singleContext		// linux only, static, the windows created after
+							// it is set draw with one context, cheaper to
+							// focus() than a context for each window
+		flushOnSwitch		// linux only, static, cleared to stop focus()
+							// from flushing the window it leaves
+
 	WindowType Functions:
 		requestClose();		// ask the window to close
 		setVSync();			// sets vsinc using option
+		joinSwapGroup(w);	// used by SwapGroup.h, which presents many
+							// windows with a single wait for vsync
 		resize();			// resizes viewPort
 		focus();			// ready window for drawing
+		isFocused();		// true if the window's context is current
 		swapBuffers();		// swap the drawing buffers
 		handleInput();		// remembers input pressed,
 							// returns true if event occured
+		handleAllInput();	// static, handles the input of all the windows
+		waitEvents(ms);		// static, sleeps until input arrives or ms pass
+		wake(); post(f);	// static, linux only, wakes waitEvents from any
+							// thread, post also runs f on the input thread
 		toString()			// returns a string that describes the window 
+		getMotionHistory();	// linux only, every mouse position of the last
+							// handleInput(), if keepMotionHistory is set
+		getMotionDropped();	// linux only, the samples of it thinned out
+		useXInput2();		// linux only, unaccelerated motion, positions
+							// with their fraction and smooth scrolling
+		getOldestEventAge();// linux only, how long the input waited before
+							// the last handleInput(), in nanoseconds
+		recordEvents();		// linux only, queues every input event of the
+		drainEvents(out);	// window, drainEvents copies them to out
+		publishSnapshots();	// linux only, readSnapshot(out) then copies the
+							// input of the last frame from any thread
+		useRenderThread();	// linux only, the window's events go through a
+							// queue to the thread that calls its handleInput()
 */
 #define GLEW_STATIC
 
@@ -25,6 +56,10 @@
 #include "Options.h"
 #if defined(__linux__)
 	#include "LinuxWindow.h"
+	std::unordered_map<Window, LinuxWindow *> LinuxWindow::eventMap;
+	bool LinuxWindow::shareRoot = false;
+	bool LinuxWindow::singleContext = false;
+	bool LinuxWindow::flushOnSwitch = true;
 	using RawWindow = LinuxWindow;
 #elif defined(_WIN32)
 	#include "WindowsWindow.h"
@@ -38,8 +73,10 @@ public:
 
 	OpenglWindow (int width, int height, std::string name = "name",
 			int msaa = 8, decltype(RawWindow::window) parrent = 0,
-			Options options = Options(), bool debug = true)
-	: RawWindow(width, height, name, msaa, parrent, debug), options(options)
+			Options options = Options(), bool debug = true,
+			const RawWindow *share = NULL)
+	: RawWindow(width, height, name, msaa, parrent, debug, share),
+			options(options)
 	{
 		setVSync(options["vSync"]);
 		initGlew();
@@ -0,0 +1,56 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/*
+	One writer publishes a value that any number of threads read without a
+	lock. The sequence is odd while the writer copies, a reader that saw it
+	change during its own copy throws the copy away and reads again. The
+	readers never make the writer wait.
+*/
+template <typename T>
+class Seqlock {
+public:
+	static_assert(std::is_trivially_copyable<T>::value,
+			"the value is copied while it may be written");
+
+	// the writer thread only
+	void store (const T& value) {
+		uint64_t seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&data, &value, sizeof(T));
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	// any thread, returns the version of the value that was read
+	uint64_t load (T& out) const {
+		for (;;) {
+			uint64_t before = sequence.load(std::memory_order_acquire);
+			if (before & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			memcpy(&out, &data, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed) == before)
+				return before / 2;
+		}
+	}
+
+	// changes with every store, a reader can skip a copy it already has
+	uint64_t version() const {
+		return sequence.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	std::atomic<uint64_t> sequence{0};
+	T data;
+};
+
+#endif
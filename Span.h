@@ -0,0 +1,21 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+
+// A view of contiguous elements owned by someone else, until std::span
+template <typename T>
+struct Span {
+	T *data = NULL;
+	size_t size = 0;
+
+	Span() = default;
+	Span (T *data, size_t size) : data(data), size(size) {}
+
+	T *begin() const { return data; }
+	T *end() const { return data + size; }
+	T& operator [] (size_t index) const { return data[index]; }
+	bool empty() const { return size == 0; }
+};
+
+#endif
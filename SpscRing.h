@@ -0,0 +1,105 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Span.h"
+
+/*
+	Lock free ring for one producer thread and one consumer thread. SIZE
+	must be a power of two, one slot is never used to tell full from empty,
+	so it holds SIZE - 1 values.
+
+	The producer and the consumer indices are on cache lines of their own,
+	so the two threads don't invalidate each other's line on every value.
+	A push to a full ring is dropped and counted in overflows(), and
+	highWater() is the most values the ring ever held.
+*/
+template <typename T, size_t SIZE>
+class SpscRing {
+public:
+	static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0,
+			"SIZE must be a power of two");
+
+	static const size_t CAPACITY = SIZE - 1;
+	static const size_t CACHE_LINE = 64;
+
+	// producer side, false if the ring is full
+	bool push (const T& value) {
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) & (SIZE - 1);
+
+		if (next == head.load(std::memory_order_acquire)) {
+			overflowCount.store(overflowCount.load(std::memory_order_relaxed) +
+					1, std::memory_order_relaxed);
+			return false;
+		}
+		buffer[tail] = value;
+		this->tail.store(next, std::memory_order_release);
+
+		size_t used = (next - head.load(std::memory_order_relaxed)) &
+				(SIZE - 1);
+		if (used > highWaterMark.load(std::memory_order_relaxed))
+			highWaterMark.store(used, std::memory_order_relaxed);
+		return true;
+	}
+
+	// consumer side, false if the ring is empty
+	bool pop (T& value) {
+		size_t head = this->head.load(std::memory_order_relaxed);
+
+		if (head == tail.load(std::memory_order_acquire))
+			return false;
+		value = buffer[head];
+		this->head.store((head + 1) & (SIZE - 1), std::memory_order_release);
+		return true;
+	}
+
+	// consumer side, copies as many values as fit in out and frees their
+	// slots at once, returns how many were copied
+	size_t drain (Span<T> out) {
+		size_t head = this->head.load(std::memory_order_relaxed);
+		size_t available = (tail.load(std::memory_order_acquire) - head) &
+				(SIZE - 1);
+		size_t count = available < out.size ? available : out.size;
+
+		for (size_t i = 0; i < count; i++)
+			out[i] = buffer[(head + i) & (SIZE - 1)];
+		this->head.store((head + count) & (SIZE - 1),
+				std::memory_order_release);
+		return count;
+	}
+
+	bool empty() const {
+		return head.load(std::memory_order_acquire) ==
+				tail.load(std::memory_order_acquire);
+	}
+
+	// exact only on the consumer or the producer thread
+	size_t size() const {
+		return (tail.load(std::memory_order_acquire) -
+				head.load(std::memory_order_acquire)) & (SIZE - 1);
+	}
+
+	uint64_t overflows() const {
+		return overflowCount.load(std::memory_order_relaxed);
+	}
+
+	size_t highWater() const {
+		return highWaterMark.load(std::memory_order_relaxed);
+	}
+
+private:
+	// written by the consumer
+	alignas(CACHE_LINE) std::atomic<size_t> head{0};
+
+	// written by the producer
+	alignas(CACHE_LINE) std::atomic<size_t> tail{0};
+	std::atomic<uint64_t> overflowCount{0};
+	std::atomic<size_t> highWaterMark{0};
+
+	alignas(CACHE_LINE) T buffer[SIZE];
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SWAP_GROUP_H
+#define SWAP_GROUP_H
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+/*
+	Presents the windows of a frame together so that only one swap waits
+	for the vertical blank. Swapping N vsynced windows one after the other
+	would wait N times and divide the frame rate by N.
+
+		SwapGroup<OpenglWindow> frame;
+		frame.add(&parrent);
+		frame.add(&child);
+		...
+		frame.swapBuffers();	// instead of each window's swapBuffers()
+
+	The first open window leads and keeps vsync, the others swap with
+	interval 0 right after it. If the driver has hardware swap groups
+	(GLX_NV_swap_group, GLX_SGIX_swap_group) all the windows keep vsync and
+	the driver swaps them together.
+
+	Each window is focused for its swap, which flushes what was drawn in it
+	even if focus() doesn't flush (flushOnSwitch), and the window that was
+	focused before is focused again after. Windows whose swap interval
+	belongs to one shared context (singleContext without
+	GLX_EXT_swap_control) can't have different intervals, add() refuses
+	them.
+*/
+template <typename WindowType>
+class SwapGroup {
+public:
+	void add (WindowType *window) {
+		for (auto&& other : windows)
+			if (window->sharesSwapInterval(other))
+				throw std::runtime_error("The windows of a SwapGroup need a "
+						"swap interval each");
+		windows.push_back(window);
+		dirty = true;
+	}
+
+	void remove (WindowType *window) {
+		if (hardware && window->active)
+			window->joinSwapGroup(NULL);
+		windows.erase(std::remove(windows.begin(), windows.end(), window),
+				windows.end());
+		dirty = true;
+	}
+
+	void setVSync (bool sync) {
+		vSync = sync;
+		dirty = true;
+	}
+
+	// false forces the interval scheme even with hardware groups
+	void useHardwareGroups (bool use) {
+		useHardware = use;
+		dirty = true;
+	}
+
+	void swapBuffers() {
+		if (!dirty && (windows.empty() || !windows[0]->active))
+			dirty = true;
+		WindowType *focused = focusedWindow();
+		if (dirty)
+			configure();
+
+		// the leader is first, the rest are swapped right after its vblank
+		for (auto&& window : windows) {
+			window->focus();
+			window->swapBuffers();
+		}
+
+		if (focused)
+			focused->focus();
+	}
+
+private:
+	std::vector<WindowType *> windows;
+	bool vSync = true;
+	bool useHardware = true;
+	bool hardware = false;
+	bool dirty = true;
+
+	WindowType *focusedWindow() {
+		for (auto&& window : windows)
+			if (window->active && window->isFocused())
+				return window;
+		return NULL;
+	}
+
+	// drops the closed windows and sets the swap intervals, which may need
+	// each window to be focused, the caller focuses the right one again
+	void configure() {
+		windows.erase(std::remove_if(windows.begin(), windows.end(),
+				[](WindowType *window) { return !window->active; }),
+				windows.end());
+		dirty = false;
+		if (windows.empty())
+			return;
+
+		bool joined = useHardware && windows.size() > 1;
+		for (auto&& window : windows)
+			joined = joined && window->joinSwapGroup(windows[0]);
+		if (!joined && hardware)
+			for (auto&& window : windows)
+				window->joinSwapGroup(NULL);
+		hardware = joined;
+
+		for (size_t i = 0; i < windows.size(); i++) {
+			windows[i]->focus();
+			windows[i]->setVSync(vSync && (hardware || i == 0));
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <atomic>
+#include <functional>
+
+// Lock free queue of closures, any thread can post() but only one thread
+// may call runAll(). Producers push on a list with a CAS and the consumer
+// takes the whole list with one exchange, so there is no ABA to guard from.
+class TaskQueue {
+public:
+	TaskQueue() {}
+
+	TaskQueue (const TaskQueue& other) = delete;
+	TaskQueue (const TaskQueue&& other) = delete;
+	TaskQueue& operator = (const TaskQueue& other) = delete;
+	TaskQueue& operator = (const TaskQueue&& other) = delete;
+
+	void post (std::function<void()> func) {
+		Node *node = new Node;
+		node->func = std::move(func);
+		node->next = head.load(std::memory_order_relaxed);
+
+		while (!head.compare_exchange_weak(node->next, node,
+				std::memory_order_release, std::memory_order_relaxed))
+			;
+	}
+
+	// runs all the closures posted until now, in the order they were posted
+	bool runAll() {
+		Node *node = head.exchange(NULL, std::memory_order_acquire);
+		Node *ordered = NULL;
+
+		while (node) {
+			Node *next = node->next;
+			node->next = ordered;
+			ordered = node;
+			node = next;
+		}
+
+		bool ran = ordered != NULL;
+		while (ordered) {
+			Node *next = ordered->next;
+			std::function<void()> func = std::move(ordered->func);
+			delete ordered;
+			ordered = next;
+			func();
+		}
+		return ran;
+	}
+
+	~TaskQueue() {
+		Node *node = head.exchange(NULL);
+		while (node) {
+			Node *next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+private:
+	struct Node {
+		std::function<void()> func;
+		Node *next;
+	};
+
+	std::atomic<Node *> head{NULL};
+};
+
+#endif
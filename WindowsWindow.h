@@ -6,7 +6,9 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
+#include <map>
 #include <functional>
+#include <vector>
 #include <windows.h>
 #include <windowsx.h>
 
@@ -45,7 +47,8 @@ public:
 	};
 
 	WindowsWindow (int width, int height, std::string name,
-			int msaa = 8, HWND parrent = 0, bool debug)
+			int msaa = 8, HWND parrent = 0, bool debug = false,
+			const WindowsWindow *share = NULL)
 	: width(width), height(height), name(name), msaa(msaa), parrent(parrent)
 	{
 		if (debug) {
@@ -58,6 +61,8 @@ public:
 		registerWindowEvent();
 		showWindow();
 		initOpengl();
+		if (share && !wglShareLists(share->hRC, hRC))
+			throw std::runtime_error("Can't share the rendering context!");
 		initKeyboard();
 
 		active = true;
@@ -94,14 +99,17 @@ public:
 			case WM_CLOSE: closePending = true; break;
 			case WM_DESTROY: closePending = true; break;
 			
+			// bit 30 of lParam is set if the key was already down
 			case WM_KEYDOWN:
 					GetKeyboardState(kbs);
 					if (ToAscii(wParam, MapVirtualKey(wParam,
 							MAPVK_VK_TO_VSC), kbs, code, 0) <= 0)
-						keyboard.registerEvent(wParam + 256, true);
+						keyboard.registerEvent(wParam + 256, true, 0, 0,
+								lParam & (1 << 30));
 					else
 						keyboard.registerEvent(code[0] +
-								(256 + wParam) * bool(!code[0]), true);
+								(256 + wParam) * bool(!code[0]), true, 0, 0,
+								lParam & (1 << 30));
 				break;
 			case WM_KEYUP:
 					GetKeyboardState(kbs);
@@ -115,8 +123,8 @@ public:
 
 			case WM_MOUSEMOVE: mouse.updateXY(GET_X_LPARAM(lParam),
 					GET_Y_LPARAM(lParam)); break;
-			case WM_MOUSEWHEEL: mouse.updateMmbPos(
-					GET_WHEEL_DELTA_WPARAM(wParam)); break;
+			case WM_MOUSEWHEEL: mouse.updateWheel(
+					GET_WHEEL_DELTA_WPARAM(wParam) / (float)WHEEL_DELTA); break;
 			
 			case WM_LBUTTONDOWN: mouse.updateLmb(true); break;
             case WM_MBUTTONDOWN: mouse.updateMmb(true); break;
@@ -255,6 +263,10 @@ public:
 			throw std::runtime_error("Can't focus rendering context!");
 	}
 
+	bool isFocused() const {
+		return wglGetCurrentContext() == hRC && wglGetCurrentDC() == hDC;
+	}
+
 	void setVSync (bool sync) {
 		if (!active)
 			return;
@@ -273,6 +285,16 @@ public:
 		}
 	}
 
+	// there are no hardware swap groups here, SwapGroup uses swap intervals
+	bool joinSwapGroup (const WindowsWindow *leader) {
+		return false;
+	}
+
+	// every window has a context of its own
+	bool sharesSwapInterval (const WindowsWindow *other) const {
+		return false;
+	}
+
 	void swapBuffers() {
 		if (!active)
 			return;
@@ -293,12 +315,56 @@ public:
 
 		if (!active)
 			return false;
+		beginInput();
 		while (PeekMessage(&msg, window, 0, 0, PM_REMOVE)) {
 			TranslateMessage(&msg);
 			DispatchMessage(&msg);
 			hadEvent = true;
 		}
 
+		finishInput();
+
+		return hadEvent; 
+	}
+
+	// dispatches the messages of all the windows, globalEventProc routes them
+	static bool handleAllInput() {
+		MSG msg;
+		bool hadEvent = false;
+
+		for (auto&& pair : eventMap)
+			pair.second->beginInput();
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+			hadEvent = true;
+		}
+
+		// close() unregisters the window, so the map can't be walked directly
+		std::vector<WindowsWindow *> windows;
+		for (auto&& pair : eventMap)
+			windows.push_back(pair.second);
+		for (auto&& window : windows)
+			window->finishInput();
+
+		return hadEvent;
+	}
+
+	// blocks until there is input for any window or timeoutMs passes
+	static bool waitEvents (int timeoutMs = -1) {
+		MsgWaitForMultipleObjects(0, NULL, FALSE,
+				timeoutMs < 0 ? INFINITE : timeoutMs, QS_ALLINPUT);
+		return handleAllInput();
+	}
+
+	void beginInput() {
+		mouse.beginFrame();
+		keyboard.beginFrame();
+	}
+
+	void finishInput() {
+		mouse.endFrame();
+		keyboard.endFrame();
 		if (needRedraw) {
 			RECT rect;
 
@@ -307,13 +373,12 @@ public:
 				height = rect.bottom - rect.top;
 				resize();
 			}
+			needRedraw = false;
 		}
 
 		if (closePending) {
 			close();
 		}
-
-		return hadEvent; 
 	}
 
 	void unregisterWindowEvent() {
@@ -330,53 +395,54 @@ public:
 		active = false;
 	}
 
+	// in the order of KeyNames::names
+	static constexpr KeyMap keyMap = makeKeyMap({
+		VK_RETURN,				// ENTER
+		VK_SPACE,				// SPACE
+		VK_CAPITAL + 256,		// CAPS_LOCK
+		VK_TAB,					// TAB
+		-1,						// L_ALT, not working?
+		-1,						// R_ALT, not working?
+		VK_CONTROL + 256,		// L_CTRL
+		VK_CONTROL + 256,		// R_CTRL
+		VK_SHIFT + 256,			// L_SHIFT
+		VK_SHIFT + 256,			// R_SHIFT
+		VK_UP + 256,			// ARROW_UP
+		VK_DOWN + 256,			// ARROW_DOWN
+		VK_LEFT + 256,			// ARROW_LEFT
+		VK_RIGHT + 256,			// ARROW_RIGHT
+		VK_F1 + 256,			// F1
+		VK_F2 + 256,			// F2
+		VK_F3 + 256,			// F3
+		VK_F4 + 256,			// F4
+		VK_F5 + 256,			// F5
+		VK_F6 + 256,			// F6
+		VK_F7 + 256,			// F7
+		VK_F8 + 256,			// F8
+		VK_F9 + 256,			// F9
+		VK_F10 + 256,			// F10
+		VK_F11 + 256,			// F11
+		VK_F12 + 256,			// F12
+		VK_BACK,				// BACKSPACE
+		VK_INSERT + 256,		// INSERT
+		VK_DELETE,				// DELETE
+		VK_HOME + 256,			// HOME
+		VK_PRIOR + 256,			// PAGE_UP
+		VK_NEXT + 256,			// PAGE_DOWN
+		VK_END + 256,			// END
+		VK_SNAPSHOT + 256,		// PRINT_SCREEN
+		VK_SCROLL + 256,		// SCREEN_LOCK
+		VK_PAUSE + 256,			// PAUSE
+		VK_NUMLOCK + 256,		// NUM_LOCK
+		VK_RETURN,				// NUM_ENTER
+		VK_INSERT,				// NUM_INSERT
+		VK_LWIN + 256,			// WINKEY
+		0,						// FN
+		VK_ESCAPE				// ESC
+	});
+
 	void initKeyboard() {
-		std::map<std::string, int> mapping;
-
-		mapping["ENTER"] = VK_RETURN;
-		mapping["SPACE"] = VK_SPACE;
-		mapping["CAPS_LOCK"] = VK_CAPITAL + 256;
-		mapping["TAB"] = VK_TAB;
-		// mapping["L_ALT"] = VK_MENU + 256; // not working?
-		// mapping["R_ALT"] = VK_MENU + 256; // not working?
-		mapping["L_CTRL"] = VK_CONTROL + 256;
-		mapping["R_CTRL"] = VK_CONTROL + 256;
-		mapping["L_SHIFT"] = VK_SHIFT + 256;
-		mapping["R_SHIFT"] = VK_SHIFT + 256;
-		mapping["ARROW_UP"] = VK_UP + 256;
-		mapping["ARROW_DOWN"] = VK_DOWN + 256;
-		mapping["ARROW_LEFT"] = VK_LEFT + 256;
-		mapping["ARROW_RIGHT"] = VK_RIGHT + 256;
-		mapping["F1"] = VK_F1 + 256;
-		mapping["F2"] = VK_F2 + 256;
-		mapping["F3"] = VK_F3 + 256;
-		mapping["F4"] = VK_F4 + 256;
-		mapping["F5"] = VK_F5 + 256;
-		mapping["F6"] = VK_F6 + 256;
-		mapping["F7"] = VK_F7 + 256;
-		mapping["F8"] = VK_F8 + 256;
-		mapping["F9"] = VK_F9 + 256;
-		mapping["F10"] = VK_F10 + 256;
-		mapping["F11"] = VK_F11 + 256;
-		mapping["F12"] = VK_F12 + 256;
-		mapping["BACKSPACE"] = VK_BACK;
-		mapping["INSERT"] = VK_INSERT + 256;
-		mapping["DELETE"] = VK_DELETE;
-		mapping["HOME"] = VK_HOME + 256;
-		mapping["PAGE_UP"] = VK_PRIOR + 256;
-		mapping["PAGE_DOWN"] = VK_NEXT + 256;
-		mapping["END"] = VK_END + 256;
-		mapping["PRINT_SCREEN"] = VK_SNAPSHOT + 256;
-		mapping["SCREEN_LOCK"] = VK_SCROLL + 256;
-		mapping["PAUSE"] = VK_PAUSE + 256;
-		mapping["NUM_LOCK"] = VK_NUMLOCK + 256;
-		mapping["NUM_ENTER"] = VK_RETURN;
-		mapping["NUM_INSERT"] = VK_INSERT;
-		mapping["WINKEY"] = VK_LWIN + 256;
-		mapping["FN"] = 0;
-		mapping["ESC"] = VK_ESCAPE;
-
-		keyboard.mapKeys(mapping);
+		keyboard.mapKeys(keyMap);
 	}
 
 	std::string toString() {
@@ -0,0 +1,244 @@
+#ifndef X_INPUT_POINTER_H
+#define X_INPUT_POINTER_H
+
+#include <map>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include "XStats.h"
+
+/*
+	An XInput2 pointer event decoded on the input thread. The event data of
+	the cookie is freed right after, so the values travel in an XEvent of
+	their own type, with the XAnyEvent fields first like every Xlib event,
+	and take the same path to the window as the core events.
+*/
+struct XIPointerEvent {
+	static const int TYPE = LASTEvent;
+
+	int type;				// TYPE
+	unsigned long serial;
+	Bool send_event;
+	Display *display;
+	Window window;
+
+	int evtype;				// XI_Motion, XI_RawMotion, XI_ButtonPress/Release
+	Time time;
+	float x;				// XI_Motion, in the window, with the fraction
+	float y;
+	float dx;				// XI_RawMotion, before the acceleration
+	float dy;
+	float scrollX;			// XI_Motion, smooth scrolling in notches
+	float scrollY;			// positive away from the user, like the wheel
+	int button;				// XI_ButtonPress/Release
+
+	void toXEvent (XEvent& event) const {
+		memcpy(&event, this, sizeof(*this));
+	}
+
+	static XIPointerEvent fromXEvent (const XEvent& event) {
+		XIPointerEvent pointer;
+		memcpy(&pointer, &event, sizeof(pointer));
+		return pointer;
+	}
+};
+
+static_assert(sizeof(XIPointerEvent) <= sizeof(XEvent) &&
+		std::is_trivially_copyable<XIPointerEvent>::value,
+		"an XIPointerEvent is carried in an XEvent");
+
+// The XInput2 state of a display: the extension's opcode and, per device,
+// the valuators that scroll and their last values
+class XInputPointer {
+public:
+	bool available = false;
+	int opcode = 0;
+
+	// asked once, by the first window that wants XInput2. Needs XInput 2.1
+	// for the scroll valuators.
+	void init (Display *display) {
+		if (this->display)
+			return;
+		this->display = display;
+
+		int event, error;
+		bool present;
+		{
+			XStatsRoundTrip roundTrip;
+			present = XQueryExtension(display, "XInputExtension", &opcode,
+					&event, &error);
+		}
+		if (!present)
+			return;
+
+		int major = 2, minor = 1;
+		XStatsRoundTrip roundTrip;
+		available = XIQueryVersion(display, &major, &minor) == Success &&
+				(major > 2 || (major == 2 && minor >= 1));
+	}
+
+	// raw motion is only reported on the root window, the device changes
+	// are needed to follow the scroll valuators
+	void selectRoot (Window root) {
+		if (rootSelected)
+			return;
+		unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {};
+		XISetMask(bits, XI_RawMotion);
+		XISetMask(bits, XI_DeviceChanged);
+		XIEventMask mask = {XIAllMasterDevices, sizeof(bits), bits};
+		XISelectEvents(display, root, &mask, 1);
+		rootSelected = true;
+	}
+
+	void selectWindow (Window window) {
+		unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {};
+		XISetMask(bits, XI_Motion);
+		XISetMask(bits, XI_ButtonPress);
+		XISetMask(bits, XI_ButtonRelease);
+		XISetMask(bits, XI_Enter);
+		XIEventMask mask = {XIAllMasterDevices, sizeof(bits), bits};
+		XISelectEvents(display, window, &mask, 1);
+	}
+
+	// Decodes an XInput2 event into out. Returns false for the events no
+	// window is interested in, the caller frees the cookie's data.
+	bool decode (const XGenericEventCookie& cookie, XIPointerEvent& out) {
+		memset(&out, 0, sizeof(out));
+		out.type = XIPointerEvent::TYPE;
+		out.serial = cookie.serial;
+		out.display = cookie.display;
+		out.evtype = cookie.evtype;
+
+		switch (cookie.evtype) {
+			case XI_RawMotion: {
+				const XIRawEvent *raw = (const XIRawEvent *)cookie.data;
+				double values[2] = {0, 0};
+				readValuators(raw->valuators, raw->raw_values, values, 2);
+				out.time = raw->time;
+				out.dx = values[0];
+				out.dy = values[1];
+				return values[0] != 0 || values[1] != 0;
+			}
+			case XI_Motion: {
+				const XIDeviceEvent *device = (const XIDeviceEvent *)cookie.data;
+				out.window = device->event;
+				out.time = device->time;
+				out.x = device->event_x;
+				out.y = device->event_y;
+				scroll(device, out);
+				return true;
+			}
+			case XI_ButtonPress:
+			case XI_ButtonRelease: {
+				const XIDeviceEvent *device = (const XIDeviceEvent *)cookie.data;
+				// the wheel buttons are repeated by the scroll valuators
+				if (device->flags & XIPointerEmulated)
+					return false;
+				out.window = device->event;
+				out.time = device->time;
+				out.x = device->event_x;
+				out.y = device->event_y;
+				out.button = device->detail;
+				return true;
+			}
+			case XI_Enter: {
+				// the valuators may have moved while the pointer was away
+				const XIEnterEvent *enter = (const XIEnterEvent *)cookie.data;
+				lastScroll.erase(enter->deviceid);
+				return false;
+			}
+			case XI_DeviceChanged:
+				scrollValuators.clear();
+				lastScroll.clear();
+				return false;
+		}
+		return false;
+	}
+
+private:
+	struct ScrollValuator {
+		int number;
+		bool vertical;
+		double increment;
+	};
+
+	Display *display = NULL;
+	bool rootSelected = false;
+	std::map<int, std::vector<ScrollValuator>> scrollValuators;
+	std::map<int, std::map<int, double>> lastScroll;
+
+	// the first count valuators, the values only hold the ones that are set
+	static void readValuators (const XIValuatorState& state,
+			const double *values, double *out, int count)
+	{
+		int index = 0;
+		for (int i = 0; i < state.mask_len * 8; i++) {
+			if (!XIMaskIsSet(state.mask, i))
+				continue;
+			if (i < count)
+				out[i] = values[index];
+			index++;
+		}
+	}
+
+	const std::vector<ScrollValuator>& valuatorsOf (int deviceid) {
+		auto it = scrollValuators.find(deviceid);
+		if (it != scrollValuators.end())
+			return it->second;
+
+		std::vector<ScrollValuator>& valuators = scrollValuators[deviceid];
+		int count = 0;
+		XIDeviceInfo *info;
+		{
+			XStatsRoundTrip roundTrip;
+			info = XIQueryDevice(display, deviceid, &count);
+		}
+		for (int i = 0; info && i < count; i++)
+			for (int j = 0; j < info[i].num_classes; j++) {
+				if (info[i].classes[j]->type != XIScrollClass)
+					continue;
+				const XIScrollClassInfo *scroll =
+						(const XIScrollClassInfo *)info[i].classes[j];
+				if (scroll->increment != 0)
+					valuators.push_back({scroll->number,
+							scroll->scroll_type == XIScrollTypeVertical,
+							scroll->increment});
+			}
+		if (info)
+			XIFreeDeviceInfo(info);
+		return valuators;
+	}
+
+	// the scroll valuators hold a position, the difference with the last
+	// one divided by the increment is the movement in notches
+	void scroll (const XIDeviceEvent *device, XIPointerEvent& out) {
+		const XIValuatorState& state = device->valuators;
+		std::map<int, double>& last = lastScroll[device->deviceid];
+
+		for (auto&& valuator : valuatorsOf(device->deviceid)) {
+			if (valuator.number >= state.mask_len * 8 ||
+					!XIMaskIsSet(state.mask, valuator.number))
+				continue;
+
+			int index = 0;
+			for (int i = 0; i < valuator.number; i++)
+				if (XIMaskIsSet(state.mask, i))
+					index++;
+			double value = state.values[index];
+
+			auto it = last.find(valuator.number);
+			if (it != last.end()) {
+				float notches = (value - it->second) / valuator.increment;
+				if (valuator.vertical)
+					out.scrollY -= notches;
+				else
+					out.scrollX += notches;
+			}
+			last[valuator.number] = value;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef X_STATS_H
+#define X_STATS_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <sstream>
+#include <iostream>
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+
+/*
+	Counts the traffic of LinuxWindow with the X server. Disabled by default,
+	when disabled every counting point costs a single branch.
+
+		XStats::get().enable(true);
+		XStats::get().dumpEvery(600);	// optional, prints to std::cerr
+		...
+		XStatsCounter c = XStats::get().method("setWindowPosition");
+		XStatsCounter f = XStats::get().lastFrame();
+
+	A frame ends every time LinuxWindow::handleAllInput() is called.
+*/
+struct XStatsCounter {
+	uint64_t calls = 0;
+	uint64_t requests = 0;		// requests sent to the server
+	uint64_t roundTrips = 0;	// calls that waited for a reply
+	uint64_t bytesWritten = 0;	// bytes flushed on the socket
+	uint64_t blockedNs = 0;		// time spent waiting for replies
+
+	void add (const XStatsCounter& other) {
+		calls += other.calls;
+		requests += other.requests;
+		roundTrips += other.roundTrips;
+		bytesWritten += other.bytesWritten;
+		blockedNs += other.blockedNs;
+	}
+
+	std::string toString() const {
+		std::stringstream ss;
+		ss << "calls: " << calls << " requests: " << requests
+				<< " roundTrips: " << roundTrips << " bytes: " << bytesWritten
+				<< " blocked[us]: " << blockedNs / 1000;
+		return ss.str();
+	}
+};
+
+class XStats {
+public:
+	static XStats& get() {
+		static XStats stats;
+		return stats;
+	}
+
+	void enable (bool enabled) {
+		this->enabled = enabled;
+	}
+
+	bool isEnabled() {
+		return enabled;
+	}
+
+	// prints toString() every frameCount frames, 0 stops the dump
+	void dumpEvery (uint64_t frameCount, std::ostream& out = std::cerr) {
+		std::lock_guard<std::mutex> lock(mutex);
+		dumpFrames = frameCount;
+		dumpStream = &out;
+	}
+
+	XStatsCounter method (const std::string& name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = methods.find(name);
+		return it != methods.end() ? it->second : XStatsCounter();
+	}
+
+	XStatsCounter lastFrame() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return previousFrame;
+	}
+
+	XStatsCounter total() {
+		std::lock_guard<std::mutex> lock(mutex);
+		XStatsCounter ret = totals;
+		ret.add(currentFrame);
+		return ret;
+	}
+
+	uint64_t frames() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return frameCount;
+	}
+
+	void reset() {
+		std::lock_guard<std::mutex> lock(mutex);
+		methods.clear();
+		totals = currentFrame = previousFrame = XStatsCounter();
+		frameCount = 0;
+	}
+
+	void endFrame() {
+		if (!enabled)
+			return;
+
+		std::string dump;
+		std::ostream *out;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			totals.add(currentFrame);
+			previousFrame = currentFrame;
+			currentFrame = XStatsCounter();
+			frameCount++;
+
+			out = dumpStream;
+			if (!dumpFrames || frameCount % dumpFrames)
+				return;
+			dump = toStringLocked();
+		}
+		*out << dump << std::flush;
+	}
+
+	std::string toString() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return toStringLocked();
+	}
+
+	// the connection being measured, set by LinuxDisplay
+	void setDisplay (Display *display) {
+		this->display = display;
+		lastXcbSequence = 0;
+	}
+
+	// Xlib only learns of the requests sent through xcb the next time it
+	// takes the socket, so the xcb calls report the sequence of their
+	// cookie here
+	void sentXcb (unsigned int sequence) {
+		if (!enabled)
+			return;
+		uint32_t last = lastXcbSequence.load(std::memory_order_relaxed);
+		while ((int32_t)(sequence - last) > 0 &&
+				!lastXcbSequence.compare_exchange_weak(last, sequence,
+				std::memory_order_relaxed))
+			;
+	}
+
+	// the sequence number of the last request sent by Xlib or by xcb
+	uint32_t lastSequence (Display *display) {
+		uint32_t xlib = NextRequest(display) - 1;
+		uint32_t xcb = lastXcbSequence.load(std::memory_order_relaxed);
+		return (int32_t)(xcb - xlib) > 0 ? xcb : xlib;
+	}
+
+	Display *getDisplay() {
+		return display;
+	}
+
+	// called by XStatsScope
+	void record (const char *name, const XStatsCounter& counter,
+			bool outermost)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		methods[name].add(counter);
+		if (outermost)
+			currentFrame.add(counter);
+	}
+
+private:
+	std::atomic<bool> enabled{false};
+	Display *display = NULL;
+	std::atomic<uint32_t> lastXcbSequence{0};
+	std::mutex mutex;
+	std::map<std::string, XStatsCounter> methods;
+	XStatsCounter totals;
+	XStatsCounter currentFrame;
+	XStatsCounter previousFrame;
+	uint64_t frameCount = 0;
+	uint64_t dumpFrames = 0;
+	std::ostream *dumpStream = &std::cerr;
+
+	XStats() {}
+
+	std::string toStringLocked() {
+		std::stringstream ss;
+		XStatsCounter all = totals;
+		all.add(currentFrame);
+
+		ss << "X stats after " << frameCount << " frames" << std::endl;
+		ss << "  last frame: " << previousFrame.toString() << std::endl;
+		ss << "  total: " << all.toString() << std::endl;
+		for (auto&& pair : methods)
+			ss << "  " << pair.first << ": " << pair.second.toString()
+					<< std::endl;
+		return ss.str();
+	}
+};
+
+// Measures one call of a window method. The requests and bytes are taken
+// from the connection, so they include the nested scopes, round trips are
+// passed up to the enclosing scope when this one ends.
+class XStatsScope {
+public:
+	XStatsScope (const char *name) : name(name) {
+		if (!XStats::get().isEnabled())
+			return;
+		display = XStats::get().getDisplay();
+		parent = current();
+		current() = this;
+		counter.calls = 1;
+		if (display) {
+			startRequest = XStats::get().lastSequence(display);
+			startWritten = xcb_total_written(XGetXCBConnection(display));
+		}
+	}
+
+	~XStatsScope() {
+		if (!current() || current() != this)
+			return;
+		current() = parent;
+
+		// The method might have opened the display, then the counting starts
+		// with the connection. If it closed it there is nothing to read.
+		Display *now = XStats::get().getDisplay();
+		if (now && (!display || now == display)) {
+			counter.requests = (uint32_t)(XStats::get().lastSequence(now) -
+					startRequest);
+			counter.bytesWritten = xcb_total_written(XGetXCBConnection(now)) -
+					startWritten;
+		}
+		if (parent) {
+			parent->counter.roundTrips += counter.roundTrips;
+			parent->counter.blockedNs += counter.blockedNs;
+		}
+		XStats::get().record(name, counter, !parent);
+	}
+
+	// marks a call that waits for the server
+	static void roundTrip (uint64_t blockedNs) {
+		if (current()) {
+			current()->counter.roundTrips++;
+			current()->counter.blockedNs += blockedNs;
+		}
+	}
+
+	XStatsScope (const XStatsScope& other) = delete;
+	XStatsScope& operator = (const XStatsScope& other) = delete;
+
+private:
+	const char *name;
+	Display *display = NULL;
+	XStatsScope *parent = NULL;
+	XStatsCounter counter;
+	uint32_t startRequest = 0;	// a new connection has sent nothing
+	uint64_t startWritten = 0;
+
+	static XStatsScope *&current() {
+		static thread_local XStatsScope *scope = NULL;
+		return scope;
+	}
+};
+
+// Put around a call that waits for a reply, counts it in the current scope
+class XStatsRoundTrip {
+public:
+	XStatsRoundTrip() {
+		if (XStats::get().isEnabled())
+			start = std::chrono::steady_clock::now();
+	}
+
+	~XStatsRoundTrip() {
+		if (!XStats::get().isEnabled())
+			return;
+		XStatsScope::roundTrip(std::chrono::duration_cast<
+				std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+				start).count());
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif
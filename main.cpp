@@ -1,5 +1,6 @@
 #include <iostream>
 #include "OpenglWindow.h"
+#include "SwapGroup.h"
 
 int main(int argc, char const *argv[])
 {
@@ -12,22 +13,25 @@ int main(int argc, char const *argv[])
 	std::cout << parrent.toString() << std::endl;
 	std::cout << child.toString() << std::endl;
 
+	SwapGroup<OpenglWindow> frame;
+	frame.add(&parrent);
+	frame.add(&child);
+
 	while (parrent.active || child.active) {
 		static float x = 0;
 		static float y = 0;
 		
-		if (parrent.handleInput()) {
-			if (parrent.keyboard.getKeyState(parrent.keyboard.ESC))
-				parrent.requestClose();
-			while (!parrent.keyboard.queEmpty())
-				std::cout << parrent.keyboard.getName(parrent.keyboard.popEvent().key) << std::endl;
-			x = -(1.0f - parrent.mouse.x / (float)parrent.width * 2);
-			y = 1.0f - parrent.mouse.y / (float)parrent.height * 2;
-		}
-
-		if (child.handleInput())
-			if (child.keyboard.getKeyState(child.keyboard.ESC))
-				child.requestClose();
+		OpenglWindow::handleAllInput();
+
+		if (parrent.keyboard.getKeyState(parrent.keyboard.ESC))
+			parrent.requestClose();
+		while (!parrent.keyboard.queEmpty())
+			std::cout << parrent.keyboard.getName(parrent.keyboard.popEvent().key) << std::endl;
+		x = -(1.0f - parrent.mouse.x / (float)parrent.width * 2);
+		y = 1.0f - parrent.mouse.y / (float)parrent.height * 2;
+
+		if (child.keyboard.getKeyState(child.keyboard.ESC))
+			child.requestClose();
 
 		child.focus();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -36,7 +40,6 @@ int main(int argc, char const *argv[])
 			glVertex2f(-1, -1);
 			glVertex2f(x, y);
 		glEnd();
-		child.swapBuffers();
 		
 		parrent.focus();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -45,7 +48,8 @@ int main(int argc, char const *argv[])
 			glVertex2f(0, 0);
 			glVertex2f(1, 1);
 		glEnd();
-		parrent.swapBuffers();
+
+		frame.swapBuffers();
 	}
 	return 0;
 }
\ No newline at end of file